@@ -0,0 +1,17 @@
+/*
+ * File:   config.h
+ *
+ * Host configuration for building zsnprintf.c with the benchmarks in this
+ * directory.  Backends may be overridden on the compiler command line.
+ *
+ * Created on October 14, 2026
+ */
+
+#ifndef CONFIG_H
+#define	CONFIG_H
+
+#include <string.h>
+
+#define ZCOAP_MEMCPY memcpy
+
+#endif	/* CONFIG_H */
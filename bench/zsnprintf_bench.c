@@ -0,0 +1,230 @@
+/*
+ * File:   zsnprintf_bench.c
+ *
+ * Created on October 14, 2026
+ *
+ * Throughput benchmark for zsnprintf against the C library's snprintf and,
+ * optionally, stb_sprintf.  A fixed corpus of realistic formats is run
+ * through each implementation with varying arguments, reporting ns/call,
+ * output MB/s, and cycles/call where a cycle counter is available.
+ *
+ * Host build, from the repository root:
+ *
+ *    cc -std=c11 -O2 -Ibench -I. bench/zsnprintf_bench.c zsnprintf.c -lm
+ *
+ * Add -DBENCH_STB with stb_sprintf.h on the include path to compare against
+ * stb_sprintf, and e.g. -DZSNPRINTF_INT_BACKEND=1 to select backends or
+ * -DZSNPRINTF_PROFILE_FAST to select a build profile.
+ *
+ * Cross builds for targets without clock_gettime define BENCH_NOW_NS() to
+ * return a monotonic time in ns, and BENCH_CYCLES() to read the core's cycle
+ * counter, e.g. DWT->CYCCNT on Cortex-M.  BENCH_ITERATIONS scales the run
+ * length and BENCH_PRINT is used for the report.
+ */
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "zsnprintf.h"
+
+#ifdef BENCH_STB
+#define STB_SPRINTF_IMPLEMENTATION
+#include "stb_sprintf.h"
+#endif
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 200000
+#endif
+
+#ifndef BENCH_PRINT
+#define BENCH_PRINT printf
+#endif
+
+#ifndef BENCH_NOW_NS
+#include <time.h>
+static uint64_t benchNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#define BENCH_NOW_NS() benchNowNs()
+#endif
+
+#ifndef BENCH_CYCLES
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#elif defined(__aarch64__)
+static inline uint64_t benchCycles(void)
+{
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+}
+#define BENCH_CYCLES() benchCycles() // generic timer ticks, not core cycles
+#endif
+#endif
+
+#define BUF_SIZE 256
+#define NVALUES 64 // argument sets cycled through, so branches see a mix
+
+/**
+ * Formatter under test.
+ */
+typedef struct impl_s {
+    const char *name;
+    int (*vsnprintf)(char *buf, size_t n, const char *fmt, va_list ap);
+} impl_t;
+
+static int zvsnprintfInt(char *buf, size_t n, const char *fmt, va_list ap)
+{
+    return (int)zvsnprintf(buf, n, fmt, ap);
+}
+
+static const impl_t impls[] = {
+    { "zsnprintf", zvsnprintfInt },
+    { "libc", vsnprintf },
+#ifdef BENCH_STB
+    { "stb", stbsp_vsnprintf },
+#endif
+};
+
+static const impl_t *current;
+
+static int run(char *buf, size_t n, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int len = current->vsnprintf(buf, n, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+static int32_t i32s[NVALUES];
+static uint64_t u64s[NVALUES];
+static double f64s[NVALUES];
+static const char *strs[NVALUES];
+
+static const char *const words[] = {
+    "ok", "timeout", "eth0", "sensor", "calibration", "/var/log/messages",
+    "x", "GET /index.html", "retry", "main",
+};
+
+/**
+ * Fill the argument tables from a fixed xorshift sequence so every build
+ * formats the same values.
+ */
+static void initValues(void)
+{
+    uint64_t x = 0x9e3779b97f4a7c15u;
+    for (unsigned i = 0; i < NVALUES; ++i) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        // spread magnitudes so short and long outputs both show up
+        i32s[i] = (int32_t)(x >> 32) >> (x % 31);
+        u64s[i] = x >> (x % 61);
+        f64s[i] = (double)(int64_t)(x >> 11) / (double)(1ull << (x % 60));
+        strs[i] = words[i % (sizeof(words) / sizeof(words[0]))];
+    }
+}
+
+static int caseDecimal(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "%d", i32s[i]);
+}
+
+static int caseIntegers(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "%d %u %5d %08x", i32s[i], (unsigned)i32s[i], i32s[i] & 0xffff, (unsigned)i32s[i]);
+}
+
+static int caseU64(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "%llu", (unsigned long long)u64s[i]);
+}
+
+static int caseHex64(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "%016llx", (unsigned long long)u64s[i]);
+}
+
+static int caseFixed(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "%.3f", f64s[i]);
+}
+
+static int caseExp(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "%e", f64s[i]);
+}
+
+static int caseGeneral(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "%g", f64s[i]);
+}
+
+static int caseStrings(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "[%12s] %s=%s", strs[i], strs[(i + 1) % NVALUES], strs[(i + 2) % NVALUES]);
+}
+
+static int caseLogLine(char *buf, unsigned i)
+{
+    return run(buf, BUF_SIZE, "%llu.%06u [%s] id=%08x rssi=%d v=%.2f",
+               (unsigned long long)(u64s[i] >> 20), (unsigned)i32s[i] % 1000000u,
+               strs[i], (unsigned)i32s[i], i32s[i] % 128, f64s[i]);
+}
+
+typedef struct bench_case_s {
+    const char *name;
+    int (*fn)(char *buf, unsigned i);
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+    { "%d", caseDecimal },
+    { "ints mix", caseIntegers },
+    { "%llu", caseU64 },
+    { "%016llx", caseHex64 },
+    { "%.3f", caseFixed },
+    { "%e", caseExp },
+    { "%g", caseGeneral },
+    { "%s padding", caseStrings },
+    { "log line", caseLogLine },
+};
+
+int main(void)
+{
+    static char buf[BUF_SIZE];
+    initValues();
+    BENCH_PRINT("%-12s %-10s %10s %10s %12s\n", "case", "impl", "ns/call", "MB/s", "cycles/call");
+    for (unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        for (unsigned m = 0; m < sizeof(impls) / sizeof(impls[0]); ++m) {
+            current = &impls[m];
+            uint64_t bytes = 0;
+            for (unsigned i = 0; i < NVALUES; ++i) {
+                cases[c].fn(buf, i); // warm up
+            }
+#ifdef BENCH_CYCLES
+            uint64_t cycles = BENCH_CYCLES();
+#endif
+            uint64_t start = BENCH_NOW_NS();
+            for (unsigned long k = 0; k < BENCH_ITERATIONS; ++k) {
+                bytes += cases[c].fn(buf, k % NVALUES);
+            }
+            uint64_t ns = BENCH_NOW_NS() - start;
+#ifdef BENCH_CYCLES
+            cycles = BENCH_CYCLES() - cycles;
+            char cyc[16];
+            snprintf(cyc, sizeof(cyc), "%.1f", (double)cycles / BENCH_ITERATIONS);
+#else
+            const char *cyc = "-";
+#endif
+            BENCH_PRINT("%-12s %-10s %10.1f %10.1f %12s\n", cases[c].name, current->name,
+                        (double)ns / BENCH_ITERATIONS, ns ? bytes * 1e3 / ns : 0.0, cyc);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,431 @@
+/*
+ * File:   zsnprintf_fuzz.c
+ *
+ * Created on October 14, 2026
+ *
+ * Differential fuzz target comparing zvsnprintf with the host vsnprintf.
+ * Each input is decoded into a conversion specification with random flags,
+ * width, precision, length and specifier, surrounded by literal text, plus
+ * an argument and an output size; any difference in the returned length or
+ * the bytes written aborts.
+ *
+ * Known deviations of zsnprintf from C99 are skipped by not generating the
+ * inputs that trigger them.  ZFUZZ_DEVIATIONS selects which ones, from the
+ * dev_* bits below; define it as 0 to fuzz everything.  With the shortest
+ * float backend, clear dev_float to fuzz float output too.
+ *
+ * libFuzzer:
+ *
+ *    clang -std=c11 -g -O1 -fsanitize=fuzzer,address -DZFUZZ_LIBFUZZER \
+ *        -Ibench -I. bench/zsnprintf_fuzz.c zsnprintf.c -lm
+ *
+ * AFL, or replaying a single input: build without -DZFUZZ_LIBFUZZER and pass
+ * the input on stdin.  Without stdin input, the standalone build runs
+ * ZFUZZ_RUNS random inputs with ./a.out -r [seed], or measures per-specifier
+ * throughput of both implementations with ./a.out -t.
+ */
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "zsnprintf.h"
+
+enum deviation_e {
+    dev_left_align = 1 << 0, // '-' flag is ignored, except for %s and %c
+    dev_alt_form = 1 << 1, // '#' flag is ignored
+    dev_hex_float = 1 << 2, // %a/%A print as %e/%E
+    dev_float = 1 << 3, // basic backend float output isn't C99 conformant
+    dev_float_default = 1 << 4, // no precision means 4 for %e/%f, shortest for %g
+    dev_precision_int = 1 << 5, // precision is ignored for integers
+    dev_pointer = 1 << 6, // %p prints bare zero-padded hex
+    dev_short_length = 1 << 7, // hh and h don't narrow the argument
+    dev_int_width = 1 << 8, // integer width excludes the sign, and is capped
+    dev_large_fixed = 1 << 9, // %f prints as %e from 1e21
+    dev_nan = 1 << 10, // NaN prints as "NAN", without sign
+};
+
+#ifndef ZFUZZ_DEVIATIONS
+#define ZFUZZ_DEVIATIONS 0x7ff
+#endif
+
+#ifndef ZFUZZ_RUNS
+#define ZFUZZ_RUNS 1000000
+#endif
+
+#define FMT_SIZE 64
+#define OUT_SIZE 512
+#define MAX_WIDTH 40
+#define MAX_PRECISION 24
+
+typedef enum arg_type_e {
+    type_int,
+    type_long,
+    type_long_long,
+    type_double,
+    type_long_double,
+    type_str,
+    type_ptr,
+    type_none,
+} arg_type_t;
+
+/**
+ * One decoded test case.
+ */
+typedef struct fuzz_case_s {
+    char fmt[FMT_SIZE];
+    arg_type_t type;
+    int stars; // number of leading int arguments for '*' and '.*'
+    int star[2];
+    long long i;
+    long double f;
+    char str[24];
+    size_t n; // output size passed to both implementations
+} fuzz_case_t;
+
+// float values at the edges of the representation
+static const double edges[] = {
+    5e-324, -5e-324, 1e-323, 1.5e-323, 2.2250738585072009e-308,
+    2.2250738585072014e-308, 1.7976931348623157e308, 0.5, 9.5, 0.125,
+};
+
+/**
+ * Input reader; runs out as zeros.
+ */
+typedef struct reader_s {
+    const uint8_t *data;
+    size_t size;
+} reader_t;
+
+static unsigned take(reader_t *r)
+{
+    if (!r->size) {
+        return 0;
+    }
+    --r->size;
+    return *r->data++;
+}
+
+static uint64_t take64(reader_t *r)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v = (v << 8) | take(r);
+    }
+    return v;
+}
+
+static void literal(reader_t *r, char **p)
+{
+    static const char chars[] = "ab =:[]-0\t";
+    unsigned len = take(r) % 4;
+    while (len--) {
+        *(*p)++ = chars[take(r) % (sizeof(chars) - 1)];
+    }
+}
+
+/**
+ * Decode fuzzer input into a test case.
+ *
+ * @param data input bytes
+ * @param size number of input bytes
+ * @param c (out) test case
+ */
+static void decode(const uint8_t *data, size_t size, fuzz_case_t *c)
+{
+    static const char specifiers[] = "diuxXofFeEgGaAcsp%";
+    static const char *const lengths[] = { "", "hh", "h", "l", "ll", "j", "z", "t" };
+    reader_t r = { data, size };
+    memset(c, 0, sizeof(*c));
+    char *p = c->fmt;
+    char spec = specifiers[take(&r) % (sizeof(specifiers) - 1)];
+    const bool floating = strchr("fFeEgGaA", spec) != NULL;
+    const bool integer = strchr("diuxXo", spec) != NULL;
+
+    if (ZFUZZ_DEVIATIONS & dev_hex_float) {
+        spec = spec == 'a' ? 'e' : spec == 'A' ? 'E' : spec;
+    }
+    const char *length = "";
+    if (integer) {
+        unsigned nlengths = sizeof(lengths) / sizeof(lengths[0]);
+        length = lengths[take(&r) % nlengths];
+        if ((ZFUZZ_DEVIATIONS & dev_short_length) && *length == 'h') {
+            length = "";
+        }
+    } else if (floating && (take(&r) & 1)) {
+        length = "L";
+    }
+    const bool wide = !strcmp(length, "ll") || !strcmp(length, "j")
+                      || (sizeof(long) > sizeof(int) && strchr("lzt", *length) && *length);
+    literal(&r, &p);
+    *p++ = '%';
+    const bool textual = spec == 's' || spec == 'c';
+    unsigned flags = take(&r);
+    if ((flags & 1) && (textual || !(ZFUZZ_DEVIATIONS & dev_left_align))) { *p++ = '-'; }
+    if (flags & 2) { *p++ = '+'; }
+    if (flags & 4) { *p++ = ' '; }
+    if ((flags & 8) && !(ZFUZZ_DEVIATIONS & dev_alt_form)) { *p++ = '#'; }
+    if (flags & 16) { *p++ = '0'; }
+
+    const bool signedInt = spec == 'd' || spec == 'i';
+    bool widthOk = true;
+    unsigned maxWidth = MAX_WIDTH;
+    if (integer && (ZFUZZ_DEVIATIONS & dev_int_width)) {
+        // widths up to the type's digit count are exact for unsigned output
+        widthOk = widthOk && !signedInt;
+        maxWidth =   spec == 'x' || spec == 'X' ? (wide ? 17 : 9)
+                   : spec == 'o' ? (wide ? 23 : 12)
+                   : 11; // 64-bit values below 2^32 share the 32-bit cap
+    }
+    unsigned width = take(&r);
+    if (widthOk && (width & 0xc0) == 0x40) {
+        p += sprintf(p, "%u", width % maxWidth);
+    } else if (widthOk && (width & 0xc0) == 0x80) {
+        *p++ = '*';
+        c->star[c->stars++] = (int)(width % maxWidth);
+    }
+    const bool precisionOk =   !(integer && (ZFUZZ_DEVIATIONS & dev_precision_int))
+                            && spec != 'c' && spec != 'p';
+    unsigned precision = take(&r);
+    if (floating && (ZFUZZ_DEVIATIONS & dev_float_default)) {
+        precision = (precision & 0x3f) | (precision & 0x80 ? 0x80 : 0x40);
+    }
+    if (precisionOk && (precision & 0xc0) == 0x40) {
+        p += sprintf(p, ".%u", precision % MAX_PRECISION);
+    } else if (precisionOk && (precision & 0xc0) == 0x80) {
+        p += sprintf(p, ".*");
+        c->star[c->stars++] = (int)(precision % MAX_PRECISION);
+    }
+
+    p += sprintf(p, "%s%c", length, spec);
+    literal(&r, &p);
+    *p = '\0';
+
+    uint64_t bits = take64(&r);
+    if (integer) {
+        // a random shift spreads magnitudes across all digit counts
+        bits >>= take(&r) % 64;
+        c->type =   !strcmp(length, "ll") || !strcmp(length, "j") ? type_long_long
+                  : *length && strchr("lzt", *length) ? type_long
+                  : type_int;
+        c->i = (long long)bits;
+    } else if (floating) {
+        double d;
+        const unsigned pick = take(&r) % 4;
+        if (pick == 0) {
+            memcpy(&d, &bits, sizeof(d));
+        } else if (pick == 1) {
+            // subnormal: few faithful digits, so %e/%g precision beyond the
+            // shortest ones must come from the exact value
+            bits &= (1ull << 52) - 1;
+            bits >>= take(&r) % 53;
+            memcpy(&d, &bits, sizeof(d));
+        } else if (pick == 2) {
+            d = edges[bits % (sizeof(edges) / sizeof(edges[0]))];
+        } else {
+            d = (double)(int64_t)bits / (double)(1ull << (take(&r) % 64));
+        }
+        if ((ZFUZZ_DEVIATIONS & dev_large_fixed) && (spec == 'f' || spec == 'F') && isfinite(d) && fabs(d) >= 1e21) {
+            d = 0.0;
+        }
+        if ((ZFUZZ_DEVIATIONS & dev_nan) && isnan(d)) {
+            d = 0.0;
+        }
+        c->type = *length == 'L' ? type_long_double : type_double;
+        c->f = d;
+    } else if (spec == 'c') {
+        c->type = type_int;
+        c->i = (unsigned char)bits;
+    } else if (spec == 's') {
+        c->type = type_str;
+        size_t len = take(&r) % sizeof(c->str);
+        for (size_t i = 0; i < len; ++i) {
+            c->str[i] = 'a' + (char)(take(&r) % 26);
+        }
+    } else if (spec == 'p') {
+        c->type = type_ptr;
+        c->i = (long long)(uintptr_t)bits;
+    } else {
+        c->type = type_none;
+    }
+    unsigned n = take(&r);
+    c->n = n < 0xf0 ? OUT_SIZE : n & 0xf;
+}
+
+/**
+ * Skip cases that hit documented float deviations of the basic backend.
+ */
+static bool floatDeviates(const fuzz_case_t *c)
+{
+    return (ZFUZZ_DEVIATIONS & dev_float) && (c->type == type_double || c->type == type_long_double);
+}
+
+static int callv(int (*fn)(char *, size_t, const char *, va_list), char *buf, size_t n, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int len = fn(buf, n, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+#define CALL(_fn, _c, _buf, _v) \
+    (  (_c)->stars == 0 ? callv(_fn, _buf, (_c)->n, (_c)->fmt, _v) \
+     : (_c)->stars == 1 ? callv(_fn, _buf, (_c)->n, (_c)->fmt, (_c)->star[0], _v) \
+     : callv(_fn, _buf, (_c)->n, (_c)->fmt, (_c)->star[0], (_c)->star[1], _v))
+
+/**
+ * Format a test case with one implementation.
+ *
+ * @param fn vsnprintf-style function
+ * @param c test case
+ * @param buf output buffer of OUT_SIZE bytes
+ * @return returned length
+ */
+static int format(int (*fn)(char *, size_t, const char *, va_list), const fuzz_case_t *c, char *buf)
+{
+    switch (c->type) {
+        case type_int: return CALL(fn, c, buf, (int)c->i);
+        case type_long: return CALL(fn, c, buf, (long)c->i);
+        case type_long_long: return CALL(fn, c, buf, c->i);
+        case type_double: return CALL(fn, c, buf, (double)c->f);
+        case type_long_double: return CALL(fn, c, buf, c->f);
+        case type_str: return CALL(fn, c, buf, c->str);
+        case type_ptr: return CALL(fn, c, buf, (void *)(uintptr_t)c->i);
+        default: return CALL(fn, c, buf, 0);
+    }
+}
+
+static int zvsnprintfInt(char *buf, size_t n, const char *fmt, va_list ap)
+{
+    return (int)zvsnprintf(buf, n, fmt, ap);
+}
+
+/**
+ * Run one input through both implementations.
+ *
+ * @return true if they agree or the case is skipped
+ */
+static bool check(const uint8_t *data, size_t size)
+{
+    fuzz_case_t c;
+    char zbuf[OUT_SIZE], lbuf[OUT_SIZE];
+    decode(data, size, &c);
+    if (floatDeviates(&c) || (c.type == type_ptr && (ZFUZZ_DEVIATIONS & dev_pointer))) {
+        return true;
+    }
+    memset(zbuf, 0x55, sizeof(zbuf));
+    memset(lbuf, 0x55, sizeof(lbuf));
+    int zlen = format(zvsnprintfInt, &c, zbuf);
+    int llen = format(vsnprintf, &c, lbuf);
+    if (zlen == llen && !memcmp(zbuf, lbuf, sizeof(zbuf))) {
+        return true;
+    }
+    fprintf(stderr, "divergence: fmt \"%s\" n %zu arg %lld / %Lg / \"%s\"\n"
+                    "  zsnprintf %d [%.*s]\n  libc      %d [%.*s]\n",
+            c.fmt, c.n, c.i, c.f, c.str,
+            zlen, (int)(c.n ? c.n - 1 : 0), zbuf, llen, (int)(c.n ? c.n - 1 : 0), lbuf);
+    return false;
+}
+
+#ifdef ZFUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (!check(data, size)) {
+        abort();
+    }
+    return 0;
+}
+
+#else
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void randomInput(uint64_t *state, uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t x = *state;
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        *state = x;
+        data[i] = (uint8_t)(x >> 24);
+    }
+}
+
+/**
+ * Time both implementations over random cases grouped by specifier.
+ */
+static void throughput(void)
+{
+    static const char specifiers[] = "diuxXofFeEgGaAcsp%";
+    enum { CASES = 512, REPS = 200 };
+    static fuzz_case_t cases[CASES];
+    static uint64_t zns[sizeof(specifiers)], lns[sizeof(specifiers)];
+    static unsigned count[sizeof(specifiers)];
+    char buf[OUT_SIZE];
+    uint64_t state = 0x2545f4914f6cdd1du;
+    for (unsigned k = 0; k < CASES; ++k) {
+        uint8_t data[64];
+        randomInput(&state, data, sizeof(data));
+        decode(data, sizeof(data), &cases[k]);
+    }
+    for (unsigned k = 0; k < CASES; ++k) {
+        const fuzz_case_t *c = &cases[k];
+        // the first specifier character after the '%' names the case
+        const char *f = strchr(c->fmt, '%') + 1;
+        const size_t s = strchr(specifiers, f[strcspn(f, specifiers)]) - specifiers;
+        uint64_t t = nowNs();
+        for (unsigned j = 0; j < REPS; ++j) {
+            format(zvsnprintfInt, c, buf);
+        }
+        zns[s] += nowNs() - t;
+        t = nowNs();
+        for (unsigned j = 0; j < REPS; ++j) {
+            format(vsnprintf, c, buf);
+        }
+        lns[s] += nowNs() - t;
+        count[s] += REPS;
+    }
+    printf("%-4s %8s %12s %12s\n", "spec", "calls", "zsnprintf ns", "libc ns");
+    for (size_t s = 0; s < sizeof(specifiers) - 1; ++s) {
+        if (count[s]) {
+            printf("%%%-3c %8u %12.1f %12.1f\n", specifiers[s], count[s],
+                   (double)zns[s] / count[s], (double)lns[s] / count[s]);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "-t")) {
+        throughput();
+        return 0;
+    }
+    if (argc > 1 && !strcmp(argv[1], "-r")) {
+        uint64_t state = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x9e3779b97f4a7c15u;
+        unsigned long failures = 0;
+        for (unsigned long k = 0; k < ZFUZZ_RUNS; ++k) {
+            uint8_t data[64];
+            randomInput(&state, data, sizeof(data));
+            failures += !check(data, sizeof(data));
+        }
+        printf("%lu runs, %lu divergences\n", (unsigned long)ZFUZZ_RUNS, failures);
+        return failures != 0;
+    }
+    uint8_t data[256];
+    size_t size = fread(data, 1, sizeof(data), stdin);
+    return check(data, size) ? 0 : 1;
+}
+
+#endif /* ZFUZZ_LIBFUZZER */
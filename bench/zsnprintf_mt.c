@@ -0,0 +1,423 @@
+/*
+ * File:   zsnprintf_mt.c
+ *
+ * Created on October 14, 2026
+ *
+ * Scaling benchmark for zsnprintf used from many threads at once.  Each of N
+ * threads formats a mixed corpus into its own buffer for a fixed number of
+ * calls, and the run reports aggregate throughput against thread count, how
+ * close that comes to N times the single-thread rate, and per-call latency
+ * percentiles.  zvsnprintf keeps no shared mutable state, so throughput
+ * should scale with the cores available; a drop in scaling points at state
+ * shared between threads, or false sharing of per-thread state.
+ *
+ * Three modes are run:
+ *
+ *    zsnprintf   zvsnprintf into a per-thread buffer
+ *    compiled    zvsnprintf_compiled, with one set of compiled formats
+ *                shared by every thread as a format cache would be
+ *    zlog        zvlog into a single shared ring, drained by one extra
+ *                consumer thread; records dropped because the ring was full
+ *                still count as calls, and are reported, and a run that
+ *                dropped nearly all of them is flagged, since its rate is
+ *                mostly that of dropping
+ *
+ * Host build, from the repository root:
+ *
+ *    cc -std=c11 -O2 -pthread -Ibench -I. bench/zsnprintf_mt.c zsnprintf.c \
+ *        zlog.c -lm
+ *
+ * ./a.out [-t max_threads] [-n calls_per_thread] [-m mode] runs 1, 2, 4, ...
+ * threads up to max_threads, by default the number of online processors.
+ * Latencies are taken with one BENCH_NOW_NS() per call, whose overhead is
+ * measured and printed; it's included in the percentiles but not in the
+ * throughput, which is timed from the first worker's start to the last
+ * worker's end, as each worker times itself once released.  Build with a larger
+ * -DZLOG_SLOTS to keep the ring from filling at high thread counts.
+ */
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime, pthread_barrier_t, getopt
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "zlog.h"
+#include "zsnprintf.h"
+
+#ifndef BENCH_CALLS
+#define BENCH_CALLS 200000 // per thread
+#endif
+
+#ifndef BENCH_PRINT
+#define BENCH_PRINT printf
+#endif
+
+#ifndef BENCH_NOW_NS
+#include <time.h>
+static uint64_t benchNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#define BENCH_NOW_NS() benchNowNs()
+#endif
+
+#define BUF_SIZE 256
+#define NVALUES 64 // argument sets cycled through, so branches see a mix
+#define CACHE_LINE 64
+#define DROP_FLAG 0.9 // zlog runs dropping more than this share are flagged
+
+// latency histogram: exact below 2^SUB_BITS ns, then 2^SUB_BITS buckets per
+// power of two, so within about 3%
+#define SUB_BITS 5
+#define LAT_BUCKETS ((64 - SUB_BITS + 1) << SUB_BITS)
+
+typedef enum bench_mode_e {
+    mode_zsnprintf,
+    mode_compiled,
+    mode_zlog,
+    MODES
+} bench_mode_t;
+
+static const char *const mode_names[MODES] = { "zsnprintf", "compiled", "zlog" };
+
+static const char *const formats[] = {
+    "%d",
+    "%d %u %5d %08x",
+    "%llu",
+    "%016llx",
+    "%.3f",
+    "[%12s] %s=%s",
+    "%llu.%06u [%s] id=%08x rssi=%d v=%.2f",
+    "{\"id\": %d, \"name\": \"%s\", \"uptime\": %llu}",
+};
+
+#define NFORMATS (sizeof(formats) / sizeof(formats[0]))
+
+static zfmt_t compiled[NFORMATS];
+static zlog_t ring;
+
+static int32_t i32s[NVALUES];
+static uint64_t u64s[NVALUES];
+static double f64s[NVALUES];
+static const char *strs[NVALUES];
+
+static const char *const words[] = {
+    "ok", "timeout", "eth0", "sensor", "calibration", "/var/log/messages",
+    "x", "GET /index.html", "retry", "main",
+};
+
+/**
+ * Fill the argument tables from a fixed xorshift sequence so every build
+ * formats the same values.
+ */
+static void initValues(void)
+{
+    uint64_t x = 0x9e3779b97f4a7c15u;
+    for (unsigned i = 0; i < NVALUES; ++i) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        // spread magnitudes so short and long outputs both show up
+        i32s[i] = (int32_t)(x >> 32) >> (x % 31);
+        u64s[i] = x >> (x % 61);
+        f64s[i] = (double)(int64_t)(x >> 11) / (double)(1ull << (x % 60));
+        strs[i] = words[i % (sizeof(words) / sizeof(words[0]))];
+    }
+}
+
+/**
+ * One thread's state, on cache lines of its own so that any slowdown with
+ * more threads comes from the formatter rather than from the benchmark.
+ */
+typedef struct worker_s {
+    _Alignas(CACHE_LINE) pthread_t thread;
+    unsigned id;
+    bench_mode_t mode;
+    unsigned long calls;
+    uint64_t bytes;
+    uint64_t start; // BENCH_NOW_NS() once released, and after the last call
+    uint64_t end;
+    uint64_t hist[LAT_BUCKETS];
+    char buf[BUF_SIZE];
+} worker_t;
+
+static pthread_barrier_t start_line;
+static atomic_bool draining;
+
+/**
+ * Format with corpus entry f in the worker's mode.
+ *
+ * @return length of the output, or 0 for a record dropped by zlog
+ */
+static size_t run(worker_t *w, unsigned f, ...)
+{
+    va_list ap;
+    va_start(ap, f);
+    size_t len;
+    switch (w->mode) {
+        case mode_zsnprintf:
+            len = zvsnprintf(w->buf, sizeof(w->buf), formats[f], ap);
+            break;
+        case mode_compiled:
+            len = zvsnprintf_compiled(w->buf, sizeof(w->buf), &compiled[f], ap);
+            break;
+        default:
+            len = zvlog(&ring, formats[f], ap) ? 1 : 0;
+            break;
+    }
+    va_end(ap);
+    return len;
+}
+
+/**
+ * Run one call from the corpus, cycling through formats and arguments.
+ */
+static size_t call(worker_t *w, unsigned long k)
+{
+    const unsigned i = (k + w->id * 7) % NVALUES;
+    switch (k % NFORMATS) {
+        case 0: return run(w, 0, i32s[i]);
+        case 1: return run(w, 1, i32s[i], (unsigned)i32s[i], i32s[i] & 0xffff, (unsigned)i32s[i]);
+        case 2: return run(w, 2, (unsigned long long)u64s[i]);
+        case 3: return run(w, 3, (unsigned long long)u64s[i]);
+        case 4: return run(w, 4, f64s[i]);
+        case 5: return run(w, 5, strs[i], strs[(i + 1) % NVALUES], strs[(i + 2) % NVALUES]);
+        case 6: return run(w, 6, (unsigned long long)(u64s[i] >> 20), (unsigned)i32s[i] % 1000000u,
+                           strs[i], (unsigned)i32s[i], i32s[i] % 128, f64s[i]);
+        default: return run(w, 7, i32s[i], strs[i], (unsigned long long)u64s[i]);
+    }
+}
+
+static unsigned bucket(uint64_t ns)
+{
+    if (ns < (1u << SUB_BITS)) {
+        return ns;
+    }
+    const unsigned e = 63 - __builtin_clzll(ns); // >= SUB_BITS
+    return ((e - SUB_BITS + 1) << SUB_BITS) + ((ns >> (e - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+}
+
+/**
+ * @return the smallest latency that falls in bucket b
+ */
+static uint64_t bucketFloor(unsigned b)
+{
+    if (b < (1u << SUB_BITS)) {
+        return b;
+    }
+    const unsigned e = (b >> SUB_BITS) + SUB_BITS - 1;
+    return ((uint64_t)(b & ((1u << SUB_BITS) - 1)) | (1u << SUB_BITS)) << (e - SUB_BITS);
+}
+
+static void *work(void *arg)
+{
+    worker_t *w = arg;
+    for (unsigned long k = 0; k < NVALUES; ++k) {
+        call(w, k); // warm up
+    }
+    pthread_barrier_wait(&start_line);
+    uint64_t prev = BENCH_NOW_NS();
+    w->start = prev;
+    for (unsigned long k = 0; k < w->calls; ++k) {
+        w->bytes += call(w, k);
+        const uint64_t now = BENCH_NOW_NS();
+        ++w->hist[bucket(now - prev)];
+        prev = now;
+    }
+    w->end = prev;
+    return NULL;
+}
+
+static void discard(void *ctx, const char *data, size_t len)
+{
+    (void)data;
+    *(uint64_t *)ctx += len;
+}
+
+static void *drain(void *arg)
+{
+    zsink_t sink = { .write = discard, .ctx = arg };
+    while (atomic_load_explicit(&draining, memory_order_relaxed)) {
+        zlog_drain(&ring, &sink);
+    }
+    zlog_drain(&ring, &sink);
+    return NULL;
+}
+
+static void spawn(pthread_t *thread, void *(*fn)(void *), void *arg)
+{
+    if (pthread_create(thread, NULL, fn, arg)) {
+        fprintf(stderr, "couldn't start a thread\n");
+        exit(1);
+    }
+}
+
+/**
+ * Find a latency percentile in a merged histogram.
+ */
+static uint64_t percentile(const uint64_t *hist, uint64_t total, double p)
+{
+    const uint64_t rank = (uint64_t)(total * p);
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < LAT_BUCKETS; ++b) {
+        seen += hist[b];
+        if (seen > rank) {
+            return bucketFloor(b);
+        }
+    }
+    return bucketFloor(LAT_BUCKETS - 1);
+}
+
+/**
+ * Run one mode with a number of threads and print a row of the report.
+ *
+ * @param single (in/out) single-thread throughput in calls/s, set by the
+ *        run with one thread and used to compute scaling after that
+ * @return false if out of memory
+ */
+static bool bench(bench_mode_t mode, unsigned nthreads, unsigned long calls, double *single)
+{
+    worker_t *workers = aligned_alloc(CACHE_LINE, nthreads * sizeof(*workers));
+    if (!workers) {
+        return false;
+    }
+    memset(workers, 0, nthreads * sizeof(*workers));
+    pthread_barrier_init(&start_line, NULL, nthreads + 1);
+    pthread_t consumer;
+    uint64_t drained = 0; // bytes, to keep the consumer's work observable
+    if (mode == mode_zlog) {
+        zlog_init(&ring);
+        atomic_store(&draining, true);
+        spawn(&consumer, drain, &drained);
+    }
+    for (unsigned t = 0; t < nthreads; ++t) {
+        worker_t *w = &workers[t];
+        w->id = t;
+        w->mode = mode;
+        w->calls = calls;
+        spawn(&w->thread, work, w);
+    }
+    pthread_barrier_wait(&start_line);
+    // the workers time themselves, so none can start or finish outside the
+    // span measured however the threads are scheduled after the barrier
+    uint64_t start = UINT64_MAX, end = 0;
+    for (unsigned t = 0; t < nthreads; ++t) {
+        pthread_join(workers[t].thread, NULL);
+        start = workers[t].start < start ? workers[t].start : start;
+        end = workers[t].end > end ? workers[t].end : end;
+    }
+    const uint64_t ns = end - start;
+    if (mode == mode_zlog) {
+        atomic_store(&draining, false);
+        pthread_join(consumer, NULL);
+    }
+    pthread_barrier_destroy(&start_line);
+
+    static uint64_t hist[LAT_BUCKETS];
+    memset(hist, 0, sizeof(hist));
+    uint64_t bytes = 0;
+    for (unsigned t = 0; t < nthreads; ++t) {
+        for (unsigned b = 0; b < LAT_BUCKETS; ++b) {
+            hist[b] += workers[t].hist[b];
+        }
+        bytes += workers[t].bytes;
+    }
+    free(workers);
+    const uint64_t total = (uint64_t)calls * nthreads;
+    const double rate = ns ? total * 1e9 / ns : 0.0;
+    if (nthreads == 1) {
+        *single = rate;
+    }
+    char note[64] = "";
+    if (mode == mode_zlog) {
+        // bytes counts the records queued, one each
+        const double dropped = total ? (double)(total - bytes) / total : 0.0;
+        snprintf(note, sizeof(note), "%.1f%% dropped%s", 100.0 * dropped,
+                 dropped > DROP_FLAG ? "; rate is mostly drops, raise ZLOG_SLOTS" : "");
+    } else {
+        snprintf(note, sizeof(note), "%.0f MB/s", ns ? bytes * 1e3 / ns : 0.0);
+    }
+    BENCH_PRINT("%-10s %7u %10.2f %8.2f %8llu %8llu %8llu  %s\n", mode_names[mode], nthreads, rate / 1e6,
+                *single ? rate / (*single * nthreads) : 0.0,
+                (unsigned long long)percentile(hist, total, 0.50),
+                (unsigned long long)percentile(hist, total, 0.99),
+                (unsigned long long)percentile(hist, total, 0.999), note);
+    return true;
+}
+
+/**
+ * @return typical cost of a BENCH_NOW_NS() call, in ns
+ */
+static double timerOverhead(void)
+{
+    const unsigned reads = 100000;
+    const uint64_t start = BENCH_NOW_NS();
+    for (unsigned i = 0; i < reads; ++i) {
+        (void)BENCH_NOW_NS();
+    }
+    return (double)(BENCH_NOW_NS() - start) / reads;
+}
+
+int main(int argc, char **argv)
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned max_threads = online > 0 ? (unsigned)online : 1;
+    unsigned long calls = BENCH_CALLS;
+    int only = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:m:")) != -1) {
+        switch (opt) {
+            case 't': max_threads = strtoul(optarg, NULL, 0); break;
+            case 'n': calls = strtoul(optarg, NULL, 0); break;
+            case 'm':
+                for (int m = 0; m < MODES; ++m) {
+                    if (!strcmp(optarg, mode_names[m])) {
+                        only = m;
+                    }
+                }
+                if (only < 0) {
+                    fprintf(stderr, "unknown mode %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t max_threads] [-n calls_per_thread] [-m zsnprintf|compiled|zlog]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (!max_threads || !calls) {
+        fprintf(stderr, "need at least one thread and one call\n");
+        return 1;
+    }
+    initValues();
+    for (unsigned f = 0; f < NFORMATS; ++f) {
+        if (!zformat_compile(formats[f], &compiled[f])) {
+            fprintf(stderr, "couldn't compile %s\n", formats[f]);
+            return 1;
+        }
+    }
+    BENCH_PRINT("%u processors online, %lu calls per thread, timer overhead %.1f ns per call (in latencies)\n",
+                online > 0 ? (unsigned)online : 0, calls, timerOverhead());
+    BENCH_PRINT("%-10s %7s %10s %8s %8s %8s %8s\n", "mode", "threads", "Mcalls/s", "scaling", "p50 ns", "p99 ns", "p99.9 ns");
+    for (int m = 0; m < MODES; ++m) {
+        if (only >= 0 && m != only) {
+            continue;
+        }
+        double single = 0.0;
+        for (unsigned n = 1;; n = n * 2 < max_threads ? n * 2 : max_threads) {
+            if (!bench(m, n, calls, &single)) {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+            if (n == max_threads) {
+                break;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * File:   zarena.c
+ *
+ * Created on October 14, 2026
+ *
+ * asprintf-style formatting into bump-pointer arenas.  Strings are carved
+ * out of large chunks, so allocating one is a pointer bump instead of a
+ * malloc, and a whole batch is released at once with zarena_reset, which
+ * keeps the chunks for reuse.  With an arena per thread nothing is shared,
+ * so there's no allocator contention between cores.
+ *
+ * Each string is formatted straight into the free space of the current
+ * chunk.  Only if it doesn't fit is it formatted again, into the next chunk,
+ * or for a string larger than a chunk into an allocation of the exact size;
+ * the first pass measures everything past the end of the chunk cheaply,
+ * without generating it.  All chunks are the same size, so those kept by
+ * zarena_reset suit any later string, and a steady workload reaches a fixed
+ * number of them.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "zarena.h"
+
+// allocator for chunks
+#ifndef ZARENA_MALLOC
+#define ZARENA_MALLOC malloc
+#endif
+#ifndef ZARENA_FREE
+#define ZARENA_FREE free
+#endif
+
+static ZSNPRINTF_THREAD_LOCAL zarena_t thread_arena;
+
+/**
+ * Initialize an empty arena.  Nothing is allocated until the first string.
+ *
+ * @param arena arena to initialize
+ * @param chunk_size size of the chunks to allocate, or 0 for
+ *        ZARENA_CHUNK_SIZE
+ */
+void zarena_init(zarena_t *arena, size_t chunk_size)
+{
+    arena->first = NULL;
+    arena->cur = NULL;
+    arena->large = NULL;
+    arena->chunk_size = chunk_size;
+}
+
+/**
+ * Free a list of chunks.
+ */
+static void freeChunks(zarena_chunk_t *chunk)
+{
+    while (chunk) {
+        zarena_chunk_t *next = chunk->next;
+        ZARENA_FREE(chunk);
+        chunk = next;
+    }
+}
+
+/**
+ * Release every string allocated from an arena at once.  Its chunks are kept
+ * and reused by later strings; only allocations for strings larger than a
+ * chunk are freed.
+ *
+ * @param arena arena to reset
+ */
+void zarena_reset(zarena_t *arena)
+{
+    for (zarena_chunk_t *chunk = arena->first; chunk; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->cur = arena->first;
+    freeChunks(arena->large);
+    arena->large = NULL;
+}
+
+/**
+ * Release every string allocated from an arena, and its memory.  The arena
+ * is left empty and can be used again.
+ *
+ * @param arena arena to free
+ */
+void zarena_free(zarena_t *arena)
+{
+    freeChunks(arena->first);
+    freeChunks(arena->large);
+    arena->first = NULL;
+    arena->cur = NULL;
+    arena->large = NULL;
+}
+
+/**
+ * The calling thread's arena, with the default chunk size.  Free it with
+ * zarena_free before the thread exits.
+ *
+ * @return arena of the calling thread
+ */
+zarena_t *zarena_thread(void)
+{
+    return &thread_arena;
+}
+
+/**
+ * Allocate a chunk.
+ *
+ * @param size bytes of data
+ * @param next chunk to link after it
+ * @return the chunk, or NULL if out of memory
+ */
+static zarena_chunk_t *newChunk(size_t size, zarena_chunk_t *next)
+{
+    zarena_chunk_t *chunk = ZARENA_MALLOC(sizeof(*chunk) + size);
+    if (chunk) {
+        chunk->next = next;
+        chunk->size = size;
+        chunk->used = 0;
+    }
+    return chunk;
+}
+
+/**
+ * Find room for a string that didn't fit in the current chunk: the next
+ * chunk, kept by zarena_reset or newly allocated, or for a string larger
+ * than a chunk an allocation of its own.
+ *
+ * @param arena arena to grow
+ * @param need bytes needed
+ * @return chunk to allocate from, or NULL if out of memory
+ */
+static zarena_chunk_t *grow(zarena_t *arena, size_t need)
+{
+    const size_t chunk_size = arena->chunk_size ? arena->chunk_size : ZARENA_CHUNK_SIZE;
+    if (need > chunk_size) {
+        zarena_chunk_t *chunk = newChunk(need, arena->large);
+        if (chunk) {
+            arena->large = chunk;
+        }
+        return chunk;
+    }
+    if (arena->cur && arena->cur->next) {
+        arena->cur = arena->cur->next;
+        return arena->cur;
+    }
+    zarena_chunk_t *chunk = newChunk(chunk_size, NULL);
+    if (!chunk) {
+        return NULL;
+    }
+    if (arena->cur) {
+        arena->cur->next = chunk;
+    } else {
+        arena->first = chunk;
+    }
+    arena->cur = chunk;
+    return chunk;
+}
+
+/**
+ * Format into a new string allocated from an arena.
+ *
+ * @param arena arena to allocate from
+ * @param fmt format string
+ * @param ap arguments
+ * @return the string, valid until the arena is reset or freed, or NULL if
+ *         out of memory
+ */
+char *zvasprintf_arena(zarena_t *arena, const char *fmt, va_list ap)
+{
+    zarena_chunk_t *chunk = arena->cur;
+    char *dst = chunk ? chunk->data + chunk->used : NULL;
+    const size_t room = chunk ? chunk->size - chunk->used : 0;
+    va_list args;
+    va_copy(args, ap);
+    const size_t len = zvsnprintf(dst, room, fmt, args);
+    va_end(args);
+    if (len >= room) {
+        chunk = grow(arena, len + 1);
+        if (!chunk) {
+            return NULL;
+        }
+        dst = chunk->data + chunk->used;
+        va_copy(args, ap);
+        zvsnprintf(dst, len + 1, fmt, args);
+        va_end(args);
+    }
+    chunk->used += len + 1;
+    return dst;
+}
+
+char *zasprintf_arena(zarena_t *arena, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    char *str = zvasprintf_arena(arena, fmt, ap);
+    va_end(ap);
+    return str;
+}
@@ -0,0 +1,61 @@
+/*
+ * File:   zarena.h
+ *
+ * Bump-pointer arenas for formatted strings built on zvsnprintf.
+ *
+ * Created on October 14, 2026
+ */
+
+#ifndef ZARENA_H
+#define	ZARENA_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include "zsnprintf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// default size of the chunks an arena allocates; larger strings get a chunk
+// of their own, released by zarena_reset
+#ifndef ZARENA_CHUNK_SIZE
+#define ZARENA_CHUNK_SIZE 4096
+#endif
+
+typedef struct zarena_chunk_s {
+    struct zarena_chunk_s *next;
+    size_t size; // bytes in data
+    size_t used;
+    char data[];
+} zarena_chunk_t;
+
+/**
+ * Strings allocated from an arena live until it's reset or freed.  A zeroed
+ * zarena_t is an empty arena with the default chunk size.  An arena isn't
+ * thread safe; use one per thread, e.g. zarena_thread().
+ */
+typedef struct zarena_s {
+    zarena_chunk_t *first;
+    zarena_chunk_t *cur; // chunk being allocated from
+    zarena_chunk_t *large; // strings too big for a chunk
+    size_t chunk_size; // 0 for ZARENA_CHUNK_SIZE
+} zarena_t;
+
+void zarena_init(zarena_t *arena, size_t chunk_size);
+void zarena_reset(zarena_t *arena);
+void zarena_free(zarena_t *arena);
+zarena_t *zarena_thread(void);
+
+char *zvasprintf_arena(zarena_t *arena, const char *fmt, va_list ap);
+#ifdef __GNUC__
+char *zasprintf_arena(zarena_t *arena, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
+#else
+char *zasprintf_arena(zarena_t *arena, const char *fmt, ...);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* ZARENA_H */
@@ -0,0 +1,144 @@
+/*
+ * File:   zlog.c
+ *
+ * Created on October 14, 2026
+ *
+ * A fixed-size log ring that any number of threads or interrupt handlers can
+ * write to without locks, drained by a single consumer.  Producers claim a
+ * slot, format straight into it with zvsnprintf_trunc, and publish it;
+ * nothing is formatted twice or copied through a staging buffer.
+ *
+ * The ring is the bounded queue of D. Vyukov: every slot carries a sequence
+ * number, so claiming a slot is a single compare-and-swap on the head and
+ * publishing it is a single release store.  A producer never waits for
+ * another: if the ring is full the record is dropped and counted, which keeps
+ * zlog safe to call from interrupt context.  A producer that is preempted
+ * between claim and publish holds back draining of later records until it
+ * finishes.
+ */
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "zlog.h"
+
+#if ZLOG_SLOTS & (ZLOG_SLOTS - 1)
+#error ZLOG_SLOTS must be a power of 2
+#endif
+
+#define SLOT_MASK (ZLOG_SLOTS - 1)
+
+/**
+ * Initialize an empty ring.  Must be called before any producer or consumer
+ * uses it.
+ *
+ * @param log ring to initialize
+ */
+void zlog_init(zlog_t *log)
+{
+    atomic_init(&log->head, 0);
+    atomic_init(&log->dropped, 0);
+    log->tail = 0;
+    for (size_t i = 0; i < ZLOG_SLOTS; ++i) {
+        atomic_init(&log->slots[i].seq, i);
+    }
+}
+
+/**
+ * Claim the slot at the head of the ring.
+ *
+ * @param log ring to claim from
+ * @param pos (out) ring position of the claimed slot
+ * @return claimed slot, or NULL if the ring is full
+ */
+static zlog_slot_t *reserve(zlog_t *log, size_t *pos)
+{
+    size_t head = atomic_load_explicit(&log->head, memory_order_relaxed);
+    for (;;) {
+        zlog_slot_t *slot = &log->slots[head & SLOT_MASK];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(seq - head);
+        if (diff == 0) {
+            // free; on failure head is reloaded and we try the next one
+            if (atomic_compare_exchange_weak_explicit(&log->head, &head, head + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *pos = head;
+                return slot;
+            }
+        } else if (diff < 0) {
+            // still holds a record from the previous lap
+            return NULL;
+        } else {
+            // another producer claimed it first
+            head = atomic_load_explicit(&log->head, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Format a record into the ring.  Output longer than ZLOG_SLOT_SIZE - 1 is
+ * truncated.
+ *
+ * @param log ring to write to
+ * @param fmt format string
+ * @param ap arguments
+ * @return true if the record was queued, false if the ring was full
+ */
+bool zvlog(zlog_t *log, const char *fmt, va_list ap)
+{
+    size_t pos;
+    zlog_slot_t *slot = reserve(log, &pos);
+    if (!slot) {
+        atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    // stop at the end of the slot; a long record mustn't hold up draining
+    slot->len = zvsnprintf_trunc(slot->text, sizeof(slot->text), NULL, fmt, ap);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+bool zlog(zlog_t *log, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    bool queued = zvlog(log, fmt, ap);
+    va_end(ap);
+    return queued;
+}
+
+/**
+ * Pass every committed record, in order, to a sink's write callback, one
+ * call per record, and free their slots.  Only one thread may drain a ring.
+ *
+ * @param log ring to drain
+ * @param sink destination; only write and ctx are used
+ * @return number of records drained
+ */
+size_t zlog_drain(zlog_t *log, zsink_t *sink)
+{
+    size_t count = 0;
+    for (;;) {
+        zlog_slot_t *slot = &log->slots[log->tail & SLOT_MASK];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != log->tail + 1) {
+            // empty, or the producer hasn't committed yet
+            return count;
+        }
+        sink->write(sink->ctx, slot->text, slot->len);
+        atomic_store_explicit(&slot->seq, log->tail + ZLOG_SLOTS, memory_order_release);
+        ++log->tail;
+        ++count;
+    }
+}
+
+/**
+ * @param log ring
+ * @return number of records dropped so far because the ring was full
+ */
+size_t zlog_dropped(zlog_t *log)
+{
+    return atomic_load_explicit(&log->dropped, memory_order_relaxed);
+}
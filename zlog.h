@@ -0,0 +1,85 @@
+/*
+ * File:   zlog.h
+ *
+ * Lock-free multi-producer, single-consumer log ring built on zvsnprintf.
+ *
+ * Created on October 14, 2026
+ */
+
+#ifndef ZLOG_H
+#define	ZLOG_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "zsnprintf.h"
+
+// the ring's atomic counters; std::atomic<size_t> has the same size and
+// representation as a C11 atomic_size_t on the compilers that have both
+#ifdef __cplusplus
+#include <atomic>
+typedef std::atomic<size_t> zlog_atomic_size_t;
+#else
+#include <stdatomic.h>
+typedef atomic_size_t zlog_atomic_size_t;
+#endif
+
+// number of records in the ring; must be a power of 2
+#ifndef ZLOG_SLOTS
+#define ZLOG_SLOTS 64
+#endif
+
+// maximum length of one record, including the terminating '\0'
+#ifndef ZLOG_SLOT_SIZE
+#define ZLOG_SLOT_SIZE 128
+#endif
+
+// cache line size; the ring indices and each slot start a line of their own,
+// so producers, the consumer and neighbouring slots don't falsely share
+#ifndef ZLOG_CACHE_LINE
+#define ZLOG_CACHE_LINE 64
+#endif
+
+#ifdef __cplusplus
+#define ZLOG_ALIGNED alignas(ZLOG_CACHE_LINE)
+#else
+#define ZLOG_ALIGNED _Alignas(ZLOG_CACHE_LINE)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * One record.  seq tells producers and the consumer whose turn it is: a slot
+ * at ring position pos is free when seq == pos, and holds a committed record
+ * when seq == pos + 1.  The alignment pads the size to whole cache lines.
+ */
+typedef struct zlog_slot_s {
+    ZLOG_ALIGNED zlog_atomic_size_t seq;
+    size_t len;
+    char text[ZLOG_SLOT_SIZE];
+} zlog_slot_t;
+
+typedef struct zlog_s {
+    ZLOG_ALIGNED zlog_atomic_size_t head; // next position to reserve, shared by producers
+    zlog_atomic_size_t dropped; // records discarded because the ring was full
+    ZLOG_ALIGNED size_t tail; // next position to drain, owned by the consumer
+    zlog_slot_t slots[ZLOG_SLOTS];
+} zlog_t;
+
+void zlog_init(zlog_t *log);
+bool zvlog(zlog_t *log, const char *fmt, va_list ap);
+#ifdef __GNUC__
+bool zlog(zlog_t *log, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
+#else
+bool zlog(zlog_t *log, const char *fmt, ...);
+#endif
+size_t zlog_drain(zlog_t *log, zsink_t *sink);
+size_t zlog_dropped(zlog_t *log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* ZLOG_H */
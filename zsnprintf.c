@@ -11,8 +11,42 @@
  * Supported features:
  *
  * * %u, i, d, x, X, o, f, e, E, g, G, a, A, s, p format specifiers
+ * * network addresses from pointers to their bytes: %pI4 for IPv4, %pI6
+ *   for IPv6 in the canonical form of RFC 5952, %pM for MAC addresses and
+ *   %pM8 for EUI-64s, and %pU for UUIDs.  These are spelled as in the Linux
+ *   kernel, as a %p that the printf format checker accepts followed by
+ *   letters.  A precision gives %pM any number of bytes, though the checker
+ *   warns about it
  * * ll, l, h, hh, L, j, z, t length specifiers
  * * zero-padding and '+' format modifiers
+ * * %s precision, which bounds the scan of the argument, and %s/%c width
+ * * format strings compiled once with zformat_compile, then formatted with
+ *   zvsnprintf_compiled without re-parsing
+ * * streaming output through a write callback with zvcbprintf, using a
+ *   fixed-size chunk buffer instead of a buffer for the whole output
+ * * tagged argument arrays with zsnprintf_args, for formatting without
+ *   varargs or float to double promotion, and zsnprintf_batch for bursts of
+ *   records sharing a compiled format
+ * * deferred formatting: zcapture stores the raw arguments in a compact
+ *   record, and zrender converts it later
+ * * single values converted from a parsed spec with zformat_int and friends,
+ *   and a C++20 front end in zsnprintf.hpp that parses formats at compile
+ *   time
+ * * buffers printed as hex with zhexdump
+ * * decimal and binary (Q format) fixed-point values printed with zfixtoa
+ *   and zqtoa, without floating point
+ * * ISO 8601 timestamps printed with zformat_timestamp, with the date part
+ *   optionally cached per thread
+ * * custom specifiers added with zspec_register, with handlers that print
+ *   straight into the output; built-in and custom specifiers are dispatched
+ *   through tables rather than comparison chains
+ * * numeric arrays formatted with one parsed conversion by zformat_i32_array
+ *   and friends
+ * * opt-in per-conversion counters and cycle profiling with ZSNPRINTF_STATS
+ * * bounded truncation with zsnprintf_trunc, which stops once the buffer is
+ *   full instead of measuring the rest of the output
+ * * cheap sizing: zsnprintf(NULL, 0, ...), and everything past the end of a
+ *   full buffer, is measured without generating integer or string output
  *
  * In addition, 32-bit doubles, which are rare but do exist, are properly
  * supported.  Microchip's XC16 compiler uses these by default.
@@ -21,7 +55,8 @@
  *
  *    * C99 %a/%A format specifiers are interpreted as %e/%E
  *    * %f produces %e output for abs(float) > INT32_MAX
- *    * the '-' flag (left justify) is ignored
+ *    * the '-' flag (left justify) is ignored, except for %s, %c and the
+ *      address conversions; a negative '*' width sets it, as in C99
  *    * the '#' alternate form flag is ignored
  *    * %g/%G aren't guaranteed to produce the most compact output,
  *      and may be printed with trailing zeros
@@ -29,6 +64,39 @@
  *      mantissa; some usages will produce output precision limited to 32 bits
  *    * long doubles (%LF) are read correctly, but cast to double
  *    * floating point output is not 100% conformant to IEEE-754
+ *
+ * Floating point limitations above can be lifted on targets with 64-bit
+ * doubles by defining ZSNPRINTF_FLOAT_BACKEND as ZSNPRINTF_FLOAT_SHORTEST in
+ * config.h.  This selects a table-driven engine using no libm calls:
+ *
+ *    * %g/%G without a precision print the shortest string that reads back
+ *      as the same double; with a precision they follow C99
+ *    * %e/%f output is correctly rounded at any precision, up to 24 digits
+ *    * width applies to the whole field, and the '#' flag is honored
+ *    * %f produces %e output for abs(double) >= 1e21
+ *    * long doubles (%LF) are read correctly, but cast to double
+ *
+ * It costs roughly 2 KB of tables and code, and up to 1 KB of stack for the
+ * exact expansion needed by precisions beyond DBL_DIG and rounding midpoints.
+ *
+ * Build profiles set the defaults of the options below in one go; define one
+ * in config.h, and any single option alongside it to override the profile:
+ *
+ *    * ZSNPRINTF_PROFILE_TINY, for parts with little flash, leaves out %o,
+ *      the address conversions, the handler table of zspec_register, the
+ *      vector hex kernels and, on 32-bit double targets, zftoal
+ *    * ZSNPRINTF_PROFILE_FAST, for hosts, selects the pair table integer
+ *      backend, and adds branch hints and forced inlining on the output path
+ *
+ * Measured on x86-64 with GCC 12: "linked" is what a program calling only
+ * zsnprintf gains with -ffunction-sections -fdata-sections -Wl,--gc-sections;
+ * data is almost all the converter table, which is read-only.  Times are
+ * ns/call from bench/zsnprintf_bench.c, built with -O2 for every profile.
+ *
+ *    profile  flags  linked text / data / bss   %d    %.3f  log line
+ *    default  -Os    13.9 KB / 1.1 KB / 1.0 KB  48    102   257
+ *    TINY     -Os    10.8 KB / 1.1 KB / 0       46    91    248
+ *    FAST     -O2    18.4 KB / 1.1 KB / 1.0 KB  41    65    202
  */
 
 #include <float.h>
@@ -42,30 +110,142 @@
 #include "config.h"
 #include "zsnprintf.h"
 
-#define MAX_WIDTH_SUB_SPEC "0-+ #"MAX_DEC_FMT_I32"."MAX_DEC_FMT_I32"ll"
+#define ZSNPRINTF_FLOAT_BASIC 0 // small, 32-bit friendly; see limitations above
+#define ZSNPRINTF_FLOAT_SHORTEST 1 // table-driven shortest round-trip output
+
+#define ZSNPRINTF_INT_NIBBLE 0 // nibble arithmetic; fast without hardware divide
+#define ZSNPRINTF_INT_PAIR_LUT 1 // "00".."99" pair table; fast on 64-bit hosts
+
+// build profiles, selected by defining one in config.h; they only change the
+// defaults of the options below, each of which config.h can still set
+#if defined(ZSNPRINTF_PROFILE_TINY) && defined(ZSNPRINTF_PROFILE_FAST)
+#error define at most one of ZSNPRINTF_PROFILE_TINY and ZSNPRINTF_PROFILE_FAST
+#endif
+
+// select with e.g. #define ZSNPRINTF_INT_BACKEND ZSNPRINTF_INT_PAIR_LUT in config.h
+#ifndef ZSNPRINTF_INT_BACKEND
+#ifdef ZSNPRINTF_PROFILE_FAST
+#define ZSNPRINTF_INT_BACKEND ZSNPRINTF_INT_PAIR_LUT
+#else
+#define ZSNPRINTF_INT_BACKEND ZSNPRINTF_INT_NIBBLE
+#endif
+#endif
+
+// select with e.g. #define ZSNPRINTF_FLOAT_BACKEND ZSNPRINTF_FLOAT_SHORTEST in config.h
+#ifndef ZSNPRINTF_FLOAT_BACKEND
+#define ZSNPRINTF_FLOAT_BACKEND ZSNPRINTF_FLOAT_BASIC
+#endif
+
+// vector kernels for hex output (SSE2 or NEON); define as 0 in config.h for
+// the scalar code, which also serves targets without either
+#ifndef ZSNPRINTF_SIMD
+#if (defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))) && !defined(ZSNPRINTF_PROFILE_TINY)
+#define ZSNPRINTF_SIMD 1
+#else
+#define ZSNPRINTF_SIMD 0
+#endif
+#endif
+
+// optional conversions; define as 0 in config.h to leave them out.  Without
+// ZSNPRINTF_OCTAL, %o takes its argument but prints nothing; without
+// ZSNPRINTF_ADDRESSES, %pM and the like print a pointer and then the letters;
+// without ZSNPRINTF_LONG_DOUBLE, %Lf and friends are
+// converted as double, which drops zftoal on 32-bit double targets
+#ifdef ZSNPRINTF_PROFILE_TINY
+#define ZSNPRINTF_OPTIONAL_DEFAULT 0
+#else
+#define ZSNPRINTF_OPTIONAL_DEFAULT 1
+#endif
+#ifndef ZSNPRINTF_OCTAL
+#define ZSNPRINTF_OCTAL ZSNPRINTF_OPTIONAL_DEFAULT
+#endif
+#ifndef ZSNPRINTF_ADDRESSES
+#define ZSNPRINTF_ADDRESSES ZSNPRINTF_OPTIONAL_DEFAULT
+#endif
+#ifndef ZSNPRINTF_LONG_DOUBLE
+#define ZSNPRINTF_LONG_DOUBLE ZSNPRINTF_OPTIONAL_DEFAULT
+#endif
+
+// zspec_register; define as 0 in config.h to drop its handler table, 128
+// pointers of RAM, in which case it always fails
+#ifndef ZSNPRINTF_CUSTOM
+#define ZSNPRINTF_CUSTOM ZSNPRINTF_OPTIONAL_DEFAULT
+#endif
+
+// branch hints and forced inlining of the output path
+#if defined(ZSNPRINTF_PROFILE_FAST) && defined(__GNUC__)
+#define LIKELY(_x) __builtin_expect(!!(_x), 1)
+#define UNLIKELY(_x) __builtin_expect(!!(_x), 0)
+#define HOT_INLINE inline __attribute__((always_inline))
+#else
+#define LIKELY(_x) (_x)
+#define UNLIKELY(_x) (_x)
+#define HOT_INLINE inline
+#endif
+
+// per-conversion counters read with zsnprintf_stats_get; define as 1 in
+// config.h for a profiling build, and ZSNPRINTF_STATS_CYCLES() as a cycle
+// counter read, e.g. DWT->CYCCNT or __rdtsc(), to time the conversions too
+#ifndef ZSNPRINTF_STATS
+#define ZSNPRINTF_STATS 0
+#endif
+
+// per-thread cache of the date part of zformat_timestamp; define as 0 or 1
+// in config.h to override the default.  It's on only when zsnprintf.h chose
+// the thread-local storage itself: with a ZSNPRINTF_THREAD_LOCAL of your own,
+// e.g. an empty one, every task might share the cache.  Either way it copes
+// with interrupt handlers that print timestamps on the same thread
+#ifndef ZSNPRINTF_TIMESTAMP_CACHE
+#ifdef ZSNPRINTF_DETECTED_TLS
+#define ZSNPRINTF_TIMESTAMP_CACHE 1
+#else
+#define ZSNPRINTF_TIMESTAMP_CACHE 0
+#endif
+#endif
+
+// keeps the compiler from moving memory accesses across it, for state shared
+// with interrupt handlers on the same thread
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define SIGNAL_FENCE() atomic_signal_fence(memory_order_seq_cst)
+#elif defined(__GNUC__)
+#define SIGNAL_FENCE() __asm__ __volatile__("" ::: "memory")
+#else
+#define SIGNAL_FENCE() ((void)0)
+#endif
+
+#if ZSNPRINTF_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#elif ZSNPRINTF_SIMD && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #define DTOCHAR(_d) ((_d) + '0')
-#define ARG_SPECIFIED -2
-#define PRECISION_UNSPECIFIED -1
 #define DEFAULT_PRECISION 4
 #define MAX_DEC_FMT_I32 "-2147483648"
 #define MAX_DEC_FMT_I16 "-32767"
+#define MAX_FLOAT_FMT "-0000000000.000000000e+4932" // widest zftoal output
+#define MAX_FIXED_FMT "-18446744073709551615.00000000000000000" // widest prepared %f output
 
 #if UINT_MAX == UINT16_MAX
 #define zxtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS16, _n, _width, _flags, false))
 #define zXtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS16, _n, _width, _flags, true))
 #define zotoa(_buf, _n, _width, _flags) (zo64toa(_buf, ZS16, _n, _width, _flags))
+#define ZS_INT ZS16
 #define zitoa zi16toa
 #define zutoa zu16toa
 #elif UINT_MAX == UINT32_MAX
 #define zxtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS32, _n, _width, _flags, false))
 #define zXtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS32, _n, _width, _flags, true))
 #define zotoa(_buf, _n, _width, _flags) (zo64toa(_buf, ZS32, _n, _width, _flags))
+#define ZS_INT ZS32
 #define zitoa zi32toa
 #define zutoa zu32toa
 #elif UINT_MAX == UINT64_MAX
 #define zxtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS64, _n, _width, _flags, false))
 #define zXtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS64, _n, _width, _flags, true))
 #define zotoa(_buf, _n, _width, _flags) (zo64toa(_buf, ZS64, _n, _width, _flags))
+#define ZS_INT ZS64
 #define zitoa zi64toa
 #define zutoa zu64toa
 #else
@@ -76,12 +256,14 @@
 #define zlxtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS32, _n, _width, _flags, false))
 #define zlXtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS32, _n, _width, _flags, true))
 #define zlotoa(_buf, _n, _width, _flags) (zo64toa(_buf, ZS32, _n, _width, _flags))
+#define ZS_LONG ZS32
 #define zltoa zi32toa
 #define zultoa zu32toa
 #elif ULONG_MAX == UINT64_MAX
 #define zlxtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS64, _n, _width, _flags, false))
 #define zlXtoa(_buf, _n, _width, _flags) (zx64toa(_buf, ZS64, _n, _width, _flags, true))
 #define zlotoa(_buf, _n, _width, _flags) (zo64toa(_buf, ZS64, _n, _width, _flags))
+#define ZS_LONG ZS64
 #define zltoa zi64toa
 #define zultoa zu64toa
 #else
@@ -112,71 +294,92 @@
 
 #endif
 
+#if ZSNPRINTF_FLOAT_BACKEND == ZSNPRINTF_FLOAT_SHORTEST
+#define CONVERT_BUF_SIZE FLOAT_BUF_SIZE
+#else
+#define CONVERT_BUF_SIZE sizeof(MAX_FLOAT_FMT)
+#endif
+
 #define GMINF 0.0001 // min for %f output style when %g specified
 #define GMAXF 999999.9 // max for %f output style when %g specified
 
-typedef enum sign_e {
-    auto_sign,
-    always_sign,
-    sign_or_space,
-} sign_t;
-
-typedef enum exp_form_e {
-    exp_none,
-    exp_e,
-    exp_E,
-} exp_form_t;
-
-typedef struct flags_s {
-    unsigned leftAlign : 1;
-    unsigned sign : 2;
-    unsigned altForm : 1;
-    unsigned zeropad : 1;
-    unsigned exp : 2;
-} fmt_flags_t;
-
 typedef enum int_size_e {
     ZS64,
     ZS32,
     ZS16,
 } int_size_t;
 
-static char xTOCHAR(uint8_t x)
+#if ZSNPRINTF_OCTAL
+static char XTOCHAR(uint8_t x)
 {
-    return x >= 0xA ? x - 0xA + 'a' : DTOCHAR(x);
+    return x >= 0xA ? x - 0xA + 'A' : DTOCHAR(x);
 }
+#endif
 
-static char XTOCHAR(uint8_t x)
+static const char hex_digits[2][16] = { "0123456789abcdef", "0123456789ABCDEF" };
+
+/**
+ * @param n value to measure
+ * @param shift bits per digit: 3 for octal, 4 for hex
+ * @return number of octal or hex digits needed to print n
+ */
+static inline unsigned zx64digits(uint64_t n, unsigned shift)
 {
-    return x >= 0xA ? x - 0xA + 'A' : DTOCHAR(x);
+#ifdef __GNUC__
+    unsigned bits = n ? 64 - __builtin_clzll(n) : 1;
+    return (bits + shift - 1) / shift;
+#else
+    unsigned ndigits = 1;
+    while (n >>= shift) {
+        ++ndigits;
+    }
+    return ndigits;
+#endif
 }
 
-static char *zx64toa(char *buf, int_size_t size, uint64_t n, unsigned width, fmt_flags_t flags, bool upper)
+/**
+ * Expand 8 bytes to 16 hex characters, in memory order, using one vector
+ * operation where available.
+ *
+ * @param dst (out) 16 hex characters; not terminated
+ * @param src 8 bytes to expand
+ * @param upper true for uppercase digits
+ */
+static inline void zhex8(char *dst, const uint8_t *src, bool upper)
 {
-    uint8_t d15=0, d14=0, d13=0, d12=0, d11=0, d10=0, d9=0, d8=0, d7=0, d6=0, d5=0, d4=0, d3=0, d2=0, d1=0, d0=0;
-    unsigned first_digit = 0;
-    char (*tochar)(uint8_t) = upper ? &XTOCHAR : &xTOCHAR;
+#if ZSNPRINTF_SIMD && defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i x = _mm_loadl_epi64((const __m128i *)src);
+    const __m128i lo = _mm_and_si128(x, mask);
+    const __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+    const __m128i nibbles = _mm_unpacklo_epi8(hi, lo);
+    // '0' + d, plus the gap up to 'a' or 'A' for d > 9
+    const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+                                          _mm_set1_epi8((upper ? 'A' : 'a') - '0' - 10));
+    const __m128i chars = _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+    _mm_storeu_si128((__m128i *)dst, chars);
+#elif ZSNPRINTF_SIMD && defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x8_t x = vld1_u8(src);
+    const uint8x8x2_t nibbles = vzip_u8(vshr_n_u8(x, 4), vand_u8(x, vdup_n_u8(0x0F)));
+    const uint8x16_t table = vld1q_u8((const uint8_t *)hex_digits[upper]);
+    vst1q_u8((uint8_t *)dst, vqtbl1q_u8(table, vcombine_u8(nibbles.val[0], nibbles.val[1])));
+#else
+    const char *digits = hex_digits[upper];
+    for (unsigned i = 0; i < 8; ++i) {
+        dst[2 * i] = digits[src[i] >> 4];
+        dst[2 * i + 1] = digits[src[i] & 0xF];
+    }
+#endif
+}
 
-    d0 = n & 0xF;
-    d1 = (n >> 4) & 0xF; if (d1) { first_digit = 1; }
-    d2 = (n >> 8) & 0xF; if (d2) { first_digit = 2; }
-    d3 = (n >> 12) & 0xF; if (d3) { first_digit = 3; }
-    if (size >= ZS32) {
-        d4 = (n >> 16) & 0xF; if (d4) { first_digit = 4; }
-        d5 = (n >> 20) & 0xF; if (d5) { first_digit = 5; }
-        d6 = (n >> 24) & 0xF; if (d6) { first_digit = 6; }
-        d7 = (n >> 28) & 0xF; if (d7) { first_digit = 7; }
-    }
-    if (size >= ZS64) {
-        d8 = (n >> 32) & 0xF; if (d8) { first_digit = 8; }
-        d9 = (n >> 36) & 0xF; if (d9) { first_digit = 9; }
-        d10 = (n >> 40) & 0xF; if (d10) { first_digit = 10; }
-        d11 = (n >> 44) & 0xF; if (d11) { first_digit = 11; }
-        d12 = (n >> 48) & 0xF; if (d12) { first_digit = 12; }
-        d13 = (n >> 52) & 0xF; if (d13) { first_digit = 13; }
-        d14 = (n >> 56) & 0xF; if (d14) { first_digit = 14; }
-        d15 = (n >> 60) & 0xF; if (d15) { first_digit = 15; }
+static char *zx64toa(char *buf, int_size_t size, uint64_t n, unsigned width, zs_flags_t flags, bool upper)
+{
+    if (size == ZS32) {
+        n = (uint32_t)n;
+    } else if (size == ZS16) {
+        n = (uint16_t)n;
     }
+    unsigned first_digit = zx64digits(n, 4) - 1;
 
     if (width) {
         // width is 1-based; change to 0-based
@@ -198,29 +401,31 @@ static char *zx64toa(char *buf, int_size_t size, uint64_t n, unsigned width, fmt
         }
     }
 
-    switch (first_digit) {
-        case 15: *buf = (*tochar)(d15); ++buf;
-        case 14: *buf = (*tochar)(d14); ++buf;
-        case 13: *buf = (*tochar)(d13); ++buf;
-        case 12: *buf = (*tochar)(d12); ++buf;
-        case 11: *buf = (*tochar)(d11); ++buf;
-        case 10: *buf = (*tochar)(d10); ++buf;
-        case 9: *buf = (*tochar)(d9); ++buf;
-        case 8: *buf = (*tochar)(d8); ++buf;
-        case 7: *buf = (*tochar)(d7); ++buf;
-        case 6: *buf = (*tochar)(d6); ++buf;
-        case 5: *buf = (*tochar)(d5); ++buf;
-        case 4: *buf = (*tochar)(d4); ++buf;
-        case 3: *buf = (*tochar)(d3); ++buf;
-        case 2: *buf = (*tochar)(d2); ++buf;
-        case 1: *buf = (*tochar)(d1); ++buf;
-    }
-    *buf = (*tochar)(d0); ++buf;
+#if ZSNPRINTF_SIMD
+    // expand all 16 digits most significant first, then keep the used ones
+    uint8_t be[8];
+    for (unsigned i = 0; i < 8; ++i) {
+        be[i] = n >> (56 - 8 * i);
+    }
+    char digits[16];
+    zhex8(digits, be, upper);
+    ZCOAP_MEMCPY(buf, digits + 15 - first_digit, first_digit + 1);
+    buf += first_digit + 1;
+#else
+    const char *digits = hex_digits[upper];
+    for (char *p = buf + first_digit; p >= buf; --p) {
+        *p = digits[n & 0xF];
+        n >>= 4;
+    }
+    buf += first_digit + 1;
+#endif
     *buf = '\0';
     return buf;
 }
 
-static char *zo64toa(char *buf, int_size_t size, uint64_t n, unsigned width, fmt_flags_t flags)
+#if ZSNPRINTF_OCTAL
+
+static char *zo64toa(char *buf, int_size_t size, uint64_t n, unsigned width, zs_flags_t flags)
 {
     uint8_t d21=0, d20=0, d19=0, d18=0, d17=0, d16=0, d15=0, d14=0, d13=0, d12=0, d11=0, d10=0, d9=0, d8=0, d7=0, d6=0, d5=0, d4=0, d3=0, d2=0, d1=0, d0=0;
     unsigned first_digit = 0;
@@ -231,14 +436,14 @@ static char *zo64toa(char *buf, int_size_t size, uint64_t n, unsigned width, fmt
     d3 = (n >> 9) & 0x7; if (d3) { first_digit = 3; }
     d4 = (n >> 12) & 0x7; if (d4) { first_digit = 4; }
     d5 = (n >> 15) & 0x7; if (d5) { first_digit = 5; }
-    if (size >= ZS32) {
+    if (size <= ZS32) {
         d6 = (n >> 18) & 0x7; if (d6) { first_digit = 6; }
         d7 = (n >> 21) & 0x7; if (d7) { first_digit = 7; }
         d8 = (n >> 24) & 0x7; if (d8) { first_digit = 8; }
         d9 = (n >> 27) & 0x7; if (d9) { first_digit = 9; }
         d10 = (n >> 30) & 0x7; if (d10) { first_digit = 10; }
     }
-    if (size >= ZS64) {
+    if (size == ZS64) {
         d11 = (n >> 33) & 0x7; if (d11) { first_digit = 11; }
         d12 = (n >> 36) & 0x7; if (d12) { first_digit = 12; }
         d13 = (n >> 39) & 0x7; if (d13) { first_digit = 13; }
@@ -300,20 +505,177 @@ static char *zo64toa(char *buf, int_size_t size, uint64_t n, unsigned width, fmt
     return buf;
 }
 
+#endif /* ZSNPRINTF_OCTAL */
+
 #define addSign(_buf, _n, _flags) {\
     if (_n < 0) {\
         *_buf = '-';\
         ++_buf;\
-    } else if (_flags.sign == always_sign) {\
+    } else if (_flags.sign == zs_always_sign) {\
         *_buf = '+';\
         ++_buf;\
-    } else if (_flags.sign == sign_or_space) {\
+    } else if (_flags.sign == zs_sign_or_space) {\
         *_buf = ' ';\
         ++_buf;\
     }\
 }
 
-static char *zi16toa(char *buf, int16_t n, unsigned width, fmt_flags_t flags)
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * Print two decimal digits from the pair table.
+ */
+static inline char *putPair(char *buf, unsigned n)
+{
+    buf[0] = digit_pairs[2 * n];
+    buf[1] = digit_pairs[2 * n + 1];
+    return buf + 2;
+}
+
+/**
+ * Count the decimal digits in an unsigned 32-bit integer.
+ *
+ * @param n integer to count the digits of
+ * @return number of digits; 1 for n == 0
+ */
+static inline unsigned zu32digits(uint32_t n)
+{
+    if (n < 10000) {
+        return n < 100 ? (n < 10 ? 1 : 2) : (n < 1000 ? 3 : 4);
+    } else if (n < 100000000) {
+        return n < 1000000 ? (n < 100000 ? 5 : 6) : (n < 10000000 ? 7 : 8);
+    }
+    return n < 1000000000 ? 9 : 10;
+}
+
+/**
+ * Print exactly ndigits decimal digits of n, most significant first,
+ * zero-filling on the left.  Digits are produced two at a time from a pair
+ * table and placed directly, so no reversal pass is needed.
+ *
+ * @param buf buffer to print to
+ * @param n integer to print
+ * @param ndigits number of digits to print
+ * @return pointer to next character in the printed buffer
+ */
+static inline char *zu32todigits(char *buf, uint32_t n, unsigned ndigits)
+{
+    char *end = buf + ndigits;
+    char *p = end;
+    for (; ndigits >= 2; ndigits -= 2) {
+        const char *pair = &digit_pairs[2 * (n % 100)];
+        n /= 100;
+        p -= 2;
+        p[0] = pair[0];
+        p[1] = pair[1];
+    }
+    if (ndigits) {
+        *--p = DTOCHAR(n);
+    }
+    return end;
+}
+
+#if ZSNPRINTF_INT_BACKEND == ZSNPRINTF_INT_PAIR_LUT
+
+/**
+ * Print the sign and width padding preceding an integer's digits, in the
+ * same order as our nibble-arithmetic converters.
+ *
+ * @param buf buffer to print to
+ * @param n negative to print a '-' sign; ignored if flags request no sign
+ * @param first_digit 0-based position of the integer's leading digit
+ * @param width 1-based width for printf
+ * @param max_width 0-based maximum width
+ * @param flags flags optionally specifying printf-style 0-pad and sign
+ * @return pointer to next character in the printed buffer
+ */
+static inline char *padInt(char *buf, int n, unsigned first_digit, unsigned width, unsigned max_width, zs_flags_t flags)
+{
+    if (width) {
+        // width is 1-based; change to 0-based
+        if (width > max_width) {
+            width = max_width;
+        } else {
+            --width;
+        }
+        if (flags.zeropad) {
+            addSign(buf, n, flags);
+            for (unsigned i = width; i > first_digit; --i) {
+                *buf = '0';
+                ++buf;
+            }
+        } else {
+            for (unsigned i = width; i > first_digit; --i) {
+                *buf = ' ';
+                ++buf;
+            }
+            addSign(buf, n, flags);
+        }
+    } else {
+        addSign(buf, n, flags);
+    }
+    return buf;
+}
+
+#if UINT_MAX == UINT16_MAX // only needed for 16-bit ints
+
+static char *zi16toa(char *buf, int16_t n, unsigned width, zs_flags_t flags)
+{
+    uint16_t absn = n < 0 ? -n : n;
+    unsigned ndigits = zu32digits(absn);
+    buf = padInt(buf, n, ndigits - 1, width, 4, flags);
+    buf = zu32todigits(buf, absn, ndigits);
+    *buf = '\0';
+    return buf;
+}
+
+static char *zu16toa(char *buf, uint16_t n, unsigned width, zs_flags_t flags)
+{
+    unsigned ndigits = zu32digits(n);
+    flags.sign = zs_auto_sign;
+    buf = padInt(buf, 0, ndigits - 1, width, 4, flags);
+    buf = zu32todigits(buf, n, ndigits);
+    *buf = '\0';
+    return buf;
+}
+
+#endif
+
+char *zi32toa(char *buf, int32_t n, unsigned width, zs_flags_t flags)
+{
+    uint32_t absn = n < 0 ? -(uint32_t)n : (uint32_t)n;
+    unsigned ndigits = zu32digits(absn);
+    buf = padInt(buf, n < 0 ? -1 : 0, ndigits - 1, width, 9, flags);
+    buf = zu32todigits(buf, absn, ndigits);
+    *buf = '\0';
+    return buf;
+}
+
+static char *zu32toa(char *buf, uint32_t n, unsigned width, zs_flags_t flags)
+{
+    unsigned ndigits = zu32digits(n);
+    flags.sign = zs_auto_sign;
+    buf = padInt(buf, 0, ndigits - 1, width, 9, flags);
+    buf = zu32todigits(buf, n, ndigits);
+    *buf = '\0';
+    return buf;
+}
+
+#else /* ZSNPRINTF_INT_NIBBLE */
+
+#if UINT_MAX == UINT16_MAX // only needed for 16-bit ints
+
+static char *zi16toa(char *buf, int16_t n, unsigned width, zs_flags_t flags)
 {
     uint8_t d4, d3, d2, d1, q; // yes, 8 bits are enough for these
     uint16_t d0;
@@ -382,7 +744,7 @@ static char *zi16toa(char *buf, int16_t n, unsigned width, fmt_flags_t flags)
     return buf;
 }
 
-static char *zu16toa(char *buf, uint16_t n, unsigned width, fmt_flags_t flags)
+static char *zu16toa(char *buf, uint16_t n, unsigned width, zs_flags_t flags)
 {
     uint8_t d4, d3, d2, d1, q; // yes, 8 bits are enough for these
     uint16_t d0;
@@ -446,7 +808,9 @@ static char *zu16toa(char *buf, uint16_t n, unsigned width, fmt_flags_t flags)
     return buf;
 }
 
-char *zi32toa(char *buf, int32_t n, unsigned width, fmt_flags_t flags)
+#endif
+
+char *zi32toa(char *buf, int32_t n, unsigned width, zs_flags_t flags)
 {
     uint8_t n0, n1, n2, n3, n4, n5, n6, n7;
     uint8_t a8, a7, a6, a5, q; // yes, 8 bits are enough for these
@@ -587,7 +951,7 @@ char *zi32toa(char *buf, int32_t n, unsigned width, fmt_flags_t flags)
     return buf;
 }
 
-static char *zu32toa(char *buf, uint32_t n, unsigned width, fmt_flags_t flags)
+static char *zu32toa(char *buf, uint32_t n, unsigned width, zs_flags_t flags)
 {
     uint8_t n0, n1, n2, n3, n4, n5, n6, n7;
     uint8_t a8, a7, a6, a5, q; // yes, 8 bits are enough for these
@@ -723,31 +1087,67 @@ static char *zu32toa(char *buf, uint32_t n, unsigned width, fmt_flags_t flags)
     return buf;
 }
 
+#endif /* ZSNPRINTF_INT_BACKEND */
+
+/**
+ * A 64-bit integer split into a leading group of up to 10 decimal digits and
+ * up to two trailing groups of exactly 8 decimal digits.
+ */
+typedef struct dec64_s {
+    uint32_t lead;
+    uint32_t groups[2];
+    unsigned ngroups;
+    unsigned first_digit; // 0-based position of the leading digit
+} dec64_t;
+
+/**
+ * Split an integer into decimal digit groups with at most two 64-bit
+ * divisions.  This is the only 64-bit arithmetic needed to print it; the
+ * groups themselves are printed with 32-bit arithmetic.
+ *
+ * @param n integer to split
+ * @param dec (out) digit groups of n
+ */
+static inline void splitDec64(uint64_t n, dec64_t *dec)
+{
+    uint64_t hi = n / 100000000;
+    uint32_t lo = n - hi * 100000000;
+    if (hi > UINT32_MAX) {
+        uint32_t top = hi / 100000000;
+        dec->lead = top;
+        dec->groups[0] = hi - (uint64_t)top * 100000000;
+        dec->groups[1] = lo;
+        dec->ngroups = 2;
+    } else {
+        dec->lead = hi;
+        dec->groups[0] = lo;
+        dec->ngroups = 1;
+    }
+    dec->first_digit = zu32digits(dec->lead) + 8 * dec->ngroups - 1;
+}
+
 /**
- * Reverse the characters in the passed buffer.
+ * Print the digit groups of a split 64-bit integer.
  *
- * @param buf (in/out) buffer of characters to reverse
- * @param end index of the last character in the passed buffer to reverse
+ * @param buf buffer to print to
+ * @param dec digit groups to print
+ * @return pointer to next character in the printed buffer
  */
-static inline void reverse(char *buf, unsigned end)
+static inline char *zdec64todigits(char *buf, const dec64_t *dec)
 {
-    unsigned start = 0;
-    while (start < end) {
-        char temp = buf[start];
-        buf[start] = buf[end];
-        buf[end] = temp;
-        ++start;
-        --end;
+    buf = zu32todigits(buf, dec->lead, dec->first_digit + 1 - 8 * dec->ngroups);
+    for (unsigned i = 0; i < dec->ngroups; ++i) {
+        buf = zu32todigits(buf, dec->groups[i], 8);
     }
+    return buf;
 }
 
 /**
  * Print a signed radix decimal 64-bit integer.  The caller is responsible for
  * ensuring the buffer is large enough.
  *
- * This isn't heavily optimized like our 16 and 32-bit functions, but it works.
- * Since this isn't heavily optimized, we call into our 32-bit function instead
- * for integers that will fit into that.
+ * Integers that fit into 32 bits are handed to our 32-bit function.  Larger
+ * ones are split into 8-digit groups and printed with 32-bit arithmetic.
  *
  * @param buf buffer to print to
  * @param n integer to print
@@ -755,31 +1155,13 @@ static inline void reverse(char *buf, unsigned end)
  * @param flags flags optionally specifying printf-style 0-pad (e.g. %04lld)
  * @return pointer to next character in the printed buffer
  */
-static char *zi64toa(char *buf, int64_t n, unsigned width, fmt_flags_t flags)
+static char *zi64toa(char *buf, int64_t n, unsigned width, zs_flags_t flags)
 {
     if (n >= INT32_MIN && n <= INT32_MAX) {
         return zi32toa(buf, n, width, flags);
     }
-    unsigned first_digit = 0;
-    char tmp[19];
-    if (n == 0) {
-        tmp[first_digit] = '0';
-    } else {
-        uint64_t _n;
-        if (n < 0) {
-            _n = -n;
-        } else {
-            _n = n;
-        }
-        while (_n) {
-            int rem = _n % 10;
-            tmp[first_digit] = rem + '0';
-            _n = _n / 10;
-            ++first_digit;
-        }
-        --first_digit;
-    }
-    reverse(tmp, first_digit);
+    dec64_t dec;
+    splitDec64(n < 0 ? -(uint64_t)n : (uint64_t)n, &dec);
     if (width) {
         // width is 1-based; change to 0-based
         if (width > 19) {
@@ -789,12 +1171,12 @@ static char *zi64toa(char *buf, int64_t n, unsigned width, fmt_flags_t flags)
         }
         if (flags.zeropad) {
             addSign(buf, n, flags);
-            for (unsigned i = width; i > first_digit; --i) {
+            for (unsigned i = width; i > dec.first_digit; --i) {
                 *buf = '0';
                 ++buf;
             }
         } else {
-            for (unsigned i = width; i > first_digit; --i) {
+            for (unsigned i = width; i > dec.first_digit; --i) {
                 *buf = ' ';
                 ++buf;
             }
@@ -803,8 +1185,7 @@ static char *zi64toa(char *buf, int64_t n, unsigned width, fmt_flags_t flags)
     } else {
         addSign(buf, n, flags);
     }
-    memcpy(buf, tmp, first_digit + 1);
-    buf += first_digit + 1;
+    buf = zdec64todigits(buf, &dec);
     *buf = '\0';
     return buf;
 }
@@ -813,9 +1194,8 @@ static char *zi64toa(char *buf, int64_t n, unsigned width, fmt_flags_t flags)
  * Print an unsigned radix decimal 64-bit integer.  The caller is responsible
  * for ensuring the buffer is large enough.
  *
- * This isn't heavily optimized like our 16 and 32-bit functions, but it works.
- * Since this isn't heavily optimized, we call into our 32-bit function instead
- * for integers that will fit into that.
+ * Integers that fit into 32 bits are handed to our 32-bit function.  Larger
+ * ones are split into 8-digit groups and printed with 32-bit arithmetic.
  *
  * @param buf buffer to print to
  * @param n integer to print
@@ -823,25 +1203,13 @@ static char *zi64toa(char *buf, int64_t n, unsigned width, fmt_flags_t flags)
  * @param flags flags optionally specifying printf-style 0-pad (e.g. %04llu)
  * @return pointer to next character in the printed buffer
  */
-static char *zu64toa(char *buf, uint64_t n, unsigned width, fmt_flags_t flags)
+static char *zu64toa(char *buf, uint64_t n, unsigned width, zs_flags_t flags)
 {
     if (n <= UINT32_MAX) {
         return zu32toa(buf, n, width, flags);
     }
-    unsigned first_digit = 0;
-    char tmp[20];
-    if (n == 0) {
-        tmp[first_digit] = '0';
-    } else {
-        while (n) {
-            int rem = n % 10;
-            tmp[first_digit] = rem + '0';
-            n = n / 10;
-            ++first_digit;
-        }
-        --first_digit;
-    }
-    reverse(tmp, first_digit);
+    dec64_t dec;
+    splitDec64(n, &dec);
     if (width) {
         // width is 1-based; change to 0-based
         if (width > 20) {
@@ -850,25 +1218,116 @@ static char *zu64toa(char *buf, uint64_t n, unsigned width, fmt_flags_t flags)
             --width;
         }
         if (flags.zeropad) {
-            for (unsigned i = width; i > first_digit; --i) {
+            for (unsigned i = width; i > dec.first_digit; --i) {
                 *buf = '0';
                 ++buf;
             }
         } else {
-            for (unsigned i = width; i > first_digit; --i) {
+            for (unsigned i = width; i > dec.first_digit; --i) {
                 *buf = ' ';
                 ++buf;
             }
         }
     }
-    memcpy(buf, tmp, first_digit + 1);
-    buf += first_digit + 1;
+    buf = zdec64todigits(buf, &dec);
     *buf = '\0';
     return buf;
 }
 
+#if ZSNPRINTF_FLOAT_BACKEND == ZSNPRINTF_FLOAT_BASIC
+
+static const float fpow10[] = { // 10^i
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f,
+    1e10f, 1e11f, 1e12f, 1e13f, 1e14f, 1e15f, 1e16f, 1e17f, 1e18f, 1e19f,
+    1e20f, 1e21f, 1e22f, 1e23f, 1e24f, 1e25f, 1e26f, 1e27f, 1e28f, 1e29f,
+    1e30f, 1e31f, 1e32f, 1e33f, 1e34f, 1e35f, 1e36f, 1e37f, 1e38f,
+};
+
+static const long double lpow10[] = { // 10^(2^i)
+    1e1L, 1e2L, 1e4L, 1e8L, 1e16L, 1e32L, 1e64L, 1e128L, 1e256L,
+#if LDBL_MAX_10_EXP >= 4096
+    1e512L, 1e1024L, 1e2048L, 1e4096L,
+#endif
+};
+
+/**
+ * Split a nonzero, finite float into a significand in [1, 10) and a decimal
+ * exponent.  The decimal exponent is estimated from the binary exponent in
+ * the float's encoding, and the significand is scaled by a single power of
+ * ten from a table, so no libm calls are needed.
+ *
+ * @param f value to split
+ * @param exponent (out) decimal exponent, such that f = returned * 10^exponent
+ * @return decimal significand of f, with the sign of f
+ */
+static float zfrexp10f(float f, int *exponent)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    int e2 = (int)((bits >> 23) & 0xFF) - 127;
+    if (e2 == -127) {
+        // subnormal; the exponent comes from the leading significand bit
+        for (uint32_t m = bits & 0x7FFFFF; m; m >>= 1) {
+            ++e2;
+        }
+        e2 -= 23;
+    }
+    int e10 = e2 * 1233 / 4096; // log10(2) ~= 1233 / 4096; within 1 of exact
+    if (e10 < -38) {
+        f *= fpow10[38]; // subnormal; scale in two steps
+        f *= fpow10[-e10 - 38];
+    } else if (e10 < 0) {
+        f *= fpow10[-e10];
+    } else {
+        f /= fpow10[e10];
+    }
+    while (fabsf(f) >= 10.0f) {
+        f /= 10.0f;
+        ++e10;
+    }
+    while (fabsf(f) < 1.0f) {
+        f *= 10.0f;
+        --e10;
+    }
+    *exponent = e10;
+    return f;
+}
+
+/**
+ * Split a nonzero, finite long double into a significand in [1, 10) and a
+ * decimal exponent.  The decimal exponent is estimated from the binary
+ * exponent, and the significand is scaled by a product of 10^(2^i) table
+ * entries.  Only frexp is needed; no transcendental functions.
+ *
+ * @param f value to split
+ * @param exponent (out) decimal exponent, such that f = returned * 10^exponent
+ * @return decimal significand of f, with the sign of f
+ */
+static long double zfrexp10l(long double f, int *exponent)
+{
+    int e2;
+    frexp(f, &e2);
+    int e10 = (e2 - 1) * 1233 / 4096; // log10(2) ~= 1233 / 4096; within 1 of exact
+    unsigned scale = e10 < 0 ? -e10 : e10;
+    for (unsigned i = 0; scale && i < sizeof(lpow10) / sizeof(lpow10[0]); ++i, scale >>= 1) {
+        if (scale & 1) {
+            f = e10 < 0 ? f * lpow10[i] : f / lpow10[i];
+        }
+    }
+    while (fabsl(f) >= 10.0L) {
+        f /= 10.0L;
+        ++e10;
+    }
+    while (fabsl(f) < 1.0L) {
+        f *= 10.0L;
+        --e10;
+    }
+    *exponent = e10;
+    return f;
+}
+
 // NOTE: saturates to INT32_MIN/INT32_MAX; fraction limited to 4 digits
-static char *zftoaf(char *buf, float f, unsigned width, unsigned precision, fmt_flags_t flags)
+static char *zftoaf(char *buf, float f, unsigned width, unsigned precision, zs_flags_t flags)
 {
     if (!isfinite(f)) {
         if (isnan(f)) {
@@ -885,18 +1344,13 @@ static char *zftoaf(char *buf, float f, unsigned width, unsigned precision, fmt_
             return buf;
         }
     }
-    if (flags.exp == exp_none && fabsf(f) > (INT32_MAX - 1)) {
-        flags.exp = exp_e;
+    if (flags.exp == zs_exp_none && fabsf(f) > (INT32_MAX - 1)) {
+        flags.exp = zs_exp_e;
     }
     int exponent = 0;
     if (flags.exp) {
         if (fabsf(f) > 0.0) {
-            exponent = log10f(fabsf(f));
-            f *= powf(10, -exponent);
-            if (!(int32_t)f) {
-                f *= 10.0;
-                --exponent;
-            }
+            f = zfrexp10f(f, &exponent);
         } else {
             exponent = 0;
         }
@@ -936,7 +1390,7 @@ static char *zftoaf(char *buf, float f, unsigned width, unsigned precision, fmt_
     if (!whole && signbit(f)) {
         *buf = '-';
         ++buf;
-        flags.sign = auto_sign;
+        flags.sign = zs_auto_sign;
     }
     if (whole > INT16_MAX || width > 4) {
         buf = zltoa(buf, whole, width, flags);
@@ -948,27 +1402,27 @@ static char *zftoaf(char *buf, float f, unsigned width, unsigned precision, fmt_
     }
     if (precision) {
         float fraction = fabsf(fmul * (rounded - whole));
-        const fmt_flags_t fraction_flags = { .zeropad = 1 };
+        const zs_flags_t fraction_flags = { .zeropad = 1 };
         if (fraction > UINT16_MAX || precision > 4) {
             buf = zultoa(buf, fraction, precision, fraction_flags);
         } else {
             buf = zutoa(buf, fraction, precision, fraction_flags);
         }
     }
-    if (flags.exp == exp_e) {
+    if (flags.exp == zs_exp_e) {
         buf[0] = 'e'; ++buf;
-        const fmt_flags_t exponent_flags = { .sign = always_sign, .zeropad = 1 };
-        zitoa(buf, exponent, 2, exponent_flags);
-    } else if (flags.exp == exp_E) {
+        const zs_flags_t exponent_flags = { .sign = zs_always_sign, .zeropad = 1 };
+        buf = zitoa(buf, exponent, 2, exponent_flags);
+    } else if (flags.exp == zs_exp_E) {
         buf[0] = 'E'; ++buf;
-        const fmt_flags_t exponent_flags = { .sign = always_sign, .zeropad = 1 };
-        zitoa(buf, exponent, 2, exponent_flags);
+        const zs_flags_t exponent_flags = { .sign = zs_always_sign, .zeropad = 1 };
+        buf = zitoa(buf, exponent, 2, exponent_flags);
     }
     return buf;
 }
 
 // NOTE: saturates to INT32_MIN/INT32_MAX; fraction limited to 9 digits
-static char *zftoal(char *buf, long double f, unsigned width, unsigned precision, fmt_flags_t flags)
+static char *zftoal(char *buf, long double f, unsigned width, unsigned precision, zs_flags_t flags)
 {
     if (!isfinite(f)) {
         if (isnan(f)) {
@@ -986,18 +1440,13 @@ static char *zftoal(char *buf, long double f, unsigned width, unsigned precision
             return buf;
         }
     }
-    if (flags.exp == exp_none && fabsl(f) > (INT32_MAX - 1)) {
-        flags.exp = exp_e;
+    if (flags.exp == zs_exp_none && fabsl(f) > (INT32_MAX - 1)) {
+        flags.exp = zs_exp_e;
     }
     int exponent = 0;
     if (flags.exp) {
         if (fabsl(f) > 0.0) {
-            exponent = log10l(fabsl(f));
-            f *= powl(10, -exponent);
-            if (!(int32_t)f) {
-                f *= 10.0;
-                --exponent;
-            }
+            f = zfrexp10l(f, &exponent);
         } else {
             exponent = 0;
         }
@@ -1037,7 +1486,7 @@ static char *zftoal(char *buf, long double f, unsigned width, unsigned precision
     if (!whole && signbit(f)) {
         *buf = '-';
         ++buf;
-        flags.sign = auto_sign;
+        flags.sign = zs_auto_sign;
     }
     if (whole > INT16_MAX || width > 4) {
         buf = zltoa(buf, whole, width, flags);
@@ -1049,324 +1498,3195 @@ static char *zftoal(char *buf, long double f, unsigned width, unsigned precision
     }
     if (precision) {
         long double fraction = fabsl(fmul * (rounded - whole));
-        const fmt_flags_t fraction_flags = { .zeropad = 1 };
+        const zs_flags_t fraction_flags = { .zeropad = 1 };
         if (fraction > UINT16_MAX || precision > 4) {
             buf = zultoa(buf, fraction, precision, fraction_flags);
         } else {
             buf = zutoa(buf, fraction, precision, fraction_flags);
         }
     }
-    if (flags.exp == exp_e) {
+    if (flags.exp == zs_exp_e) {
         buf[0] = 'e'; ++buf;
-        const fmt_flags_t exponent_flags = { .sign = always_sign, .zeropad = 1 };
-        zitoa(buf, exponent, 3, exponent_flags);
-    } else if (flags.exp == exp_E) {
+        const zs_flags_t exponent_flags = { .sign = zs_always_sign, .zeropad = 1 };
+        buf = zitoa(buf, exponent, 3, exponent_flags);
+    } else if (flags.exp == zs_exp_E) {
         buf[0] = 'E'; ++buf;
-        const fmt_flags_t exponent_flags = { .sign = always_sign, .zeropad = 1 };
-        zitoa(buf, exponent, 3, exponent_flags);
+        const zs_flags_t exponent_flags = { .sign = zs_always_sign, .zeropad = 1 };
+        buf = zitoa(buf, exponent, 3, exponent_flags);
     }
     return buf;
 }
 
-// endptr must be non-null
-static inline fmt_flags_t getFlags(char *subspec, char **endptr)
+#endif /* ZSNPRINTF_FLOAT_BASIC */
+
+typedef struct zout_s {
+    char *dest;
+    size_t remain;
+    size_t len;
+    zsink_t *sink; // NULL when formatting into a caller's buffer
+    bool stop; // stop formatting once the buffer is full, for zsnprintf_trunc
+} zout_t;
+
+#if ZSNPRINTF_STATS
+static ZSNPRINTF_THREAD_LOCAL zsnprintf_stats_t stats;
+
+/**
+ * Output state before a conversion, to attribute its output in statsRecord.
+ */
+typedef struct stats_mark_s {
+    size_t len;
+    size_t remain;
+#ifdef ZSNPRINTF_STATS_CYCLES
+    uint64_t start;
+#endif
+} stats_mark_t;
+
+static inline stats_mark_t statsMark(const zout_t *out)
 {
-    fmt_flags_t flags = { 0 };
-    char *flag;
-    char *end_of_flags = strpbrk(subspec, ".123456789");
-    char flag_dlm = 0;
-    if (end_of_flags) {
-        // cap the flags string
-        flag_dlm = *end_of_flags;
-        *end_of_flags = '\0';
-    }
-    while ((flag = strpbrk(subspec, "0-+ #"))) {
-        if (*flag == '-') {
-            flags.leftAlign = 1; // '-' flag not currently supported
-        } else if (*flag == '+') {
-            flags.sign = always_sign;
-        } else if (*flag == ' ' && flags.sign != always_sign) {
-            flags.sign = sign_or_space;
-        } else if (*flag == '#') { // '#' flag not currently supported
-            flags.altForm = 1;
-        } else if (*flag == '0') {
-            flags.zeropad = 1;
-        }
-        ++subspec;
-    }
-    if (end_of_flags) {
-        // restore sub-spec
-        *end_of_flags = flag_dlm;
-    }
-    *endptr = subspec;
-    return flags;
+    stats_mark_t mark = { .len = out->len, .remain = out->remain };
+#ifdef ZSNPRINTF_STATS_CYCLES
+    mark.start = ZSNPRINTF_STATS_CYCLES();
+#endif
+    return mark;
 }
 
-// endptr must be non-null
-static inline int getWidth(char *subspec, char **endptr)
+/**
+ * Count a finished conversion against its specifier class and length.
+ *
+ * @param out output state after the conversion
+ * @param spec conversion specification
+ * @param mark output state before the conversion
+ */
+static void statsRecord(const zout_t *out, const zspec_t *spec, const stats_mark_t *mark)
 {
-    if (*subspec == '*') {
-        // special case; grab width from args
-        *endptr = subspec + 1;
-        return ARG_SPECIFIED;
+    zstat_class_t cls;
+    switch (spec->specifier) {
+        case 'd': case 'i': cls = zstat_d; break;
+        case 'u': cls = zstat_u; break;
+        case 'x': case 'X': cls = zstat_x; break;
+        case 'o': cls = zstat_o; break;
+        case 'f': case 'F': cls = zstat_f; break;
+        case 'e': case 'E': case 'a': case 'A': cls = zstat_e; break;
+        case 'g': case 'G': cls = zstat_g; break;
+        case 's': cls = zstat_s; break;
+        case 'c': cls = zstat_c; break;
+        case 'p': cls = zstat_p; break;
+        default: return;
     }
-    *endptr = subspec;
-    return strtol(subspec, endptr, 10);
+    zstat_t *stat = &stats.conv[cls][spec->length];
+    const size_t bytes = out->len - mark->len;
+    ++stat->calls;
+    stat->bytes += bytes;
+    // the last character that fits in a buffer is replaced by the '\0';
+    // sizing with a NULL buffer isn't truncation
+    stat->truncated += !out->sink && out->dest && bytes && bytes >= mark->remain;
+#ifdef ZSNPRINTF_STATS_CYCLES
+    stat->cycles += (uint64_t)(ZSNPRINTF_STATS_CYCLES() - mark->start);
+#endif
 }
 
-// endptr must be non-null
-static inline int getPrecision(char *subspec, char **endptr)
+/**
+ * Count a finished formatting call.
+ *
+ * @param truncated true if the output didn't fit
+ */
+static inline void statsCall(bool truncated)
 {
-    char *delimiter = strchr(subspec, '.');
-    if (delimiter == NULL) {
-        *endptr = subspec;
-        return PRECISION_UNSPECIFIED;
-    }
-    char *precstr = delimiter + 1;
-    if (*precstr == '*') {
-        // special case; grab width from args
-        *endptr = subspec + 1;
-        return ARG_SPECIFIED;
-    }
-    *endptr = precstr;
-    int precval = strtol(precstr, endptr, 10);
-    if (*endptr == precstr) {
-        // couldn't parse precision
-        return PRECISION_UNSPECIFIED;
-    } else {
-        return precval;
-    }
+    ++stats.calls;
+    stats.truncated += truncated;
 }
 
-typedef enum length_e {
-    length_int,
-    length_long,
-    length_long_long,
-} length_t;
+/**
+ * Copy the calling thread's counters, accumulated since the thread started
+ * or last called zsnprintf_stats_reset.
+ *
+ * @param out (out) counters
+ */
+void zsnprintf_stats_get(zsnprintf_stats_t *out)
+{
+    *out = stats;
+}
 
-static inline length_t getLength(const char * subspec) {
-    if (strstr(subspec, "ll")) {
-        return length_long_long;
-    }
-    if (strchr(subspec, 'l')) {
-        return length_long;
-    }
-    if (strchr(subspec, 'L')) {
-        return length_long;
-    }
-    if (strstr(subspec, "j")) {
-        return length_long_long;
-    }
-    if (strstr(subspec, "hh")) {
-        return length_int;
-    }
-    if (strstr(subspec, "h")) {
-        return length_int;
-    }
-    #ifdef SIZE_MAX
-    if (strstr(subspec, "z")) {
-        #if SIZE_MAX <= UINT_MAX
-        return length_int;
-	#elif SIZE_MAX == ULONG_MAX
-        return length_long;
-	#elif SIZE_MAX = ULLONG_MAX
-        return length_long_long;
-	#else
-	#error unsupported SIZE_MAX
-	#endif
+/**
+ * Zero the calling thread's counters.
+ */
+void zsnprintf_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+#endif /* ZSNPRINTF_STATS */
+
+/**
+ * Hand the filled part of the sink's chunk to its write callback and
+ * start over at the beginning of the chunk.
+ *
+ * @param out output state streaming to a sink
+ */
+static void drain(zout_t *out)
+{
+    zsink_t *sink = out->sink;
+    if (out->dest != sink->chunk) {
+        sink->write(sink->ctx, sink->chunk, out->dest - sink->chunk);
     }
-    #endif /* SIZE_MAX */
-    #ifdef PTRDIFF_MAX
-    if (strstr(subspec, "t")) {
-        #if PTRDIFF_MAX <= INT_MAX
-        return length_int;
-	#elif PTRDIFF_MAX == LONG_MAX
-        return length_long;
-	#elif PTRDIFF_MAX = LLONG_MAX
-        return length_long_long;
-	#else
-	#error unsupported PTRDIFF_MAX
-	#endif
+    out->dest = sink->chunk;
+    out->remain = sizeof(sink->chunk);
+}
+
+/**
+ * Slow path of emit for sinks: fill the chunk, drain, and repeat.  Spans no
+ * smaller than the chunk bypass it and go straight to the callback.
+ *
+ * @param out output state streaming to a sink
+ * @param src token to write
+ * @param toklen length of the token; larger than out->remain
+ */
+static void stream(zout_t *out, const char *src, size_t toklen)
+{
+    ZCOAP_MEMCPY(out->dest, src, out->remain);
+    out->dest += out->remain;
+    src += out->remain;
+    toklen -= out->remain;
+    drain(out);
+    if (toklen >= out->remain) {
+        out->sink->write(out->sink->ctx, src, toklen);
+        return;
     }
-    #endif /* PTRDIFF_MAX */
-    return length_int;
+    ZCOAP_MEMCPY(out->dest, src, toklen);
+    out->dest += toklen;
+    out->remain -= toklen;
 }
 
-static inline void getSubspec(char *buf, unsigned maxlen, const char *escape, const char *specifier)
+static HOT_INLINE void emit(zout_t *out, const char *src, size_t toklen)
 {
-    size_t len = specifier - (escape + 1);
-    len = len >= maxlen ? maxlen - 1 : len;
-    ZCOAP_MEMCPY(buf, escape + 1, len);
-    buf[len] = '\0';
+    out->len += toklen;
+    if (UNLIKELY(toklen > out->remain)) {
+        if (out->sink) {
+            stream(out, src, toklen);
+            return;
+        }
+        toklen = out->remain;
+    }
+    out->remain -= toklen;
+    ZCOAP_MEMCPY(out->dest, src, toklen);
+    out->dest += toklen;
 }
 
-size_t zvsnprintf(char *buf, size_t n, const char *fmt, va_list ap)
+static inline size_t finish(zout_t *out, char *buf, size_t n)
 {
-    size_t remain = n, len = 0;
-    const char *src = fmt;
-    char *dest = buf;
-    const char *escape;
-    while ((escape = strchr(src, '%'))) {
-        size_t toklen = escape - src;
-        len += toklen;
-        if (toklen >= remain) {
-            toklen = remain;
-        }
-        remain -= toklen;
-        ZCOAP_MEMCPY(dest, src, toklen);
-        dest += toklen;
-        const char *tok = NULL;
-        const char *spec = strpbrk(escape + 1, "duxXfFeEgGs%iocpaA");
-        if (spec) {
-            src = spec + 1;
-            char tmp[sizeof(MAX_DEC_FMT_I32"."MAX_DEC_FMT_I32)];
-            char subspec[sizeof(MAX_WIDTH_SUB_SPEC)];
-            getSubspec(subspec, sizeof(subspec), escape, spec);
-            char *endptr = subspec;
-            fmt_flags_t flags = getFlags(endptr, &endptr);
-            unsigned width = getWidth(endptr, &endptr);
-            if (width == ARG_SPECIFIED) { width = va_arg(ap, int); }
-            unsigned precision = getPrecision(endptr, &endptr);
-            if (precision == ARG_SPECIFIED) { precision = va_arg(ap, int); }
-            length_t length = getLength(endptr);
-            if (*spec == '%') {
-                tok = "%";
-            } else if (   *spec == 'd' || *spec == 'i'
-                       || *spec == 'u'
-                       || *spec == 'x' || *spec == 'X'
-                       || *spec == 'o') {
-                if (length == length_int) {
-                    unsigned val = va_arg(ap, int);
-                    if (*spec == 'd' || *spec == 'i') {
-                        zitoa(tmp, val, width, flags);
-                    } else if (*spec == 'u') {
-                        zutoa(tmp, val, width, flags);
-                    } else if (*spec == 'x') {
-                        zxtoa(tmp, val, width, flags);
-                    } else if (*spec == 'X') {
-                        zXtoa(tmp, val, width, flags);
-		    } else if (*spec == 'o') {
-                        zotoa(tmp, val, width, flags);
-		    }
-                } else if (length == length_long) {
-                    long unsigned val = va_arg(ap, long int);
-                    if (*spec == 'd' || *spec == 'i') {
-                        zltoa(tmp, val, width, flags);
-                    } else if (*spec == 'u') {
-                        zultoa(tmp, val, width, flags);
-                    } else if (*spec == 'x') {
-                        zlxtoa(tmp, val, width, flags);
-                    } else if (*spec == 'X') {
-                        zlXtoa(tmp, val, width, flags);
-		    } else if (*spec == 'o') {
-                        zlotoa(tmp, val, width, flags);
-		    }
-                } else if (length == length_long_long) {
-                    long long unsigned val = va_arg(ap, long long int);
-                    if (*spec == 'd' || *spec == 'i') {
-                        zlltoa(tmp, val, width, flags);
-                    } else if (*spec == 'u') {
-                        zulltoa(tmp, val, width, flags);
-                    } else if (*spec == 'x') {
-                        zllxtoa(tmp, val, width, flags);
-                    } else if (*spec == 'X') {
-                        zllXtoa(tmp, val, width, flags);
-		    } else if (*spec == 'o') {
-                        zllotoa(tmp, val, width, flags);
-		    }
-                }
-                tok = tmp;
-            } else if (   *spec == 'f' || *spec == 'F'
-                       || *spec == 'e' || *spec == 'E'
-                       || *spec == 'g' || *spec == 'G'
-                       || *spec == 'a' || *spec == 'A') {
-                if (length == length_long) {
-                    long double val = va_arg(ap, long double);
-                    if (*spec == 'e' || *spec == 'a') {
-                        flags.exp = exp_e;
-                    } else if (*spec == 'E' || *spec == 'A') {
-                        flags.exp = exp_E;
-                    } else  if (*spec == 'g' || *spec == 'G') {
-                        long double absv = fabsl(val);
-                        if (absv < GMINF || absv > GMAXF) {
-                            if (*spec == 'g') {
-                                flags.exp = exp_e;
-                            } else {
-                                flags.exp = exp_E;
-                            }
-                        }
-                    }
-                    zftoal(tmp, val, width, precision == PRECISION_UNSPECIFIED ? DEFAULT_PRECISION : precision, flags);
-                } else {
-                    double val = va_arg(ap, double);
-                    if (*spec == 'e' || *spec == 'a') {
-                        flags.exp = exp_e;
-                    } else if (*spec == 'E' || *spec == 'A') {
-                        flags.exp = exp_E;
-                    } else  if (*spec == 'g' || *spec == 'G') {
-                        double absv = fabs(val);
-                        if (absv < GMINF || absv > GMAXF) {
-                            if (*spec == 'g') {
-                                flags.exp = exp_e;
-                            } else {
-                                flags.exp = exp_E;
-                            }
-                        }
+#if ZSNPRINTF_STATS
+    statsCall(n && out->len >= n);
+#endif
+    if (out->remain) {
+        *out->dest = '\0';
+    } else if (n) {
+        buf[n - 1] = '\0';
+    }
+    return out->len;
+}
+
+#if ZSNPRINTF_FLOAT_BACKEND == ZSNPRINTF_FLOAT_SHORTEST
+
+#if DBL_MANT_DIG != 53
+#error ZSNPRINTF_FLOAT_SHORTEST requires IEEE-754 64-bit doubles
+#endif
+
+/*
+ * Shortest round-trip double formatting, after Loitsch's Grisu2: "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010.
+ *
+ * The value is scaled by a cached power of ten into a 64-bit fixed-point
+ * window, and digits are generated with integer arithmetic only.  Output
+ * always parses back to the same double, and is the shortest such string
+ * in all but a tiny fraction of cases where it's one digit longer.
+ */
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_EXPONENT_MASK 0x7FF0000000000000ULL
+#define DP_EXPONENT_BIAS (0x3FF + 52)
+#define SHORTEST_MAX_DIGITS 17
+#define FLOAT_MAX_PRECISION 24 // digits past 17 significant are always zero
+#define FLOAT_MAX_FIXED 21 // %f output switches to %e at 1e21
+#define FLOAT_BUF_SIZE 64
+#define EXACT_MAX_DIGITS 770 // 2^-1074 has 767 significant digits
+#define BIG_WORDS 82 // 2^53 * 5^1074 < 2^2560
+
+typedef struct diy_fp_s {
+    uint64_t f;
+    int e;
+} diy_fp_t;
+
+// 10^-348, 10^-340, ..., 10^340 normalized to 64-bit significands
+static const uint64_t cached_powers_f[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const int16_t cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+static const uint64_t pow10_u64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+    1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+static inline diy_fp_t diyMul(diy_fp_t x, diy_fp_t y)
+{
+    const uint64_t m32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    tmp += 1ULL << 31; // round
+    diy_fp_t r = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+    return r;
+}
+
+static inline diy_fp_t diyNormalize(diy_fp_t x)
+{
+#ifdef __GNUC__
+    int s = __builtin_clzll(x.f);
+    x.f <<= s;
+    x.e -= s;
+#else
+    while (!(x.f & 0x8000000000000000ULL)) {
+        x.f <<= 1;
+        --x.e;
+    }
+#endif
+    return x;
+}
+
+/**
+ * Generate the digits of a positive, finite double.
+ *
+ * @param bits raw IEEE-754 encoding of the double
+ * @param digits (out) decimal digits, not terminated; SHORTEST_MAX_DIGITS long
+ * @param K (out) decimal exponent such that value = digits * 10^K
+ * @return number of digits generated
+ */
+static int grisu2(uint64_t bits, char *digits, int *K)
+{
+    diy_fp_t v;
+    const int biased_e = (bits & DP_EXPONENT_MASK) >> 52;
+    const uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+    if (biased_e) {
+        v.f = significand + DP_HIDDEN_BIT;
+        v.e = biased_e - DP_EXPONENT_BIAS;
+    } else {
+        v.f = significand;
+        v.e = 1 - DP_EXPONENT_BIAS;
+    }
+
+    // boundaries m- and m+ halfway to the neighboring doubles
+    diy_fp_t mp = diyNormalize((diy_fp_t){ (v.f << 1) + 1, v.e - 1 });
+    diy_fp_t mm = (v.f == DP_HIDDEN_BIT) ? (diy_fp_t){ (v.f << 2) - 1, v.e - 2 } : (diy_fp_t){ (v.f << 1) - 1, v.e - 1 };
+    mm.f <<= mm.e - mp.e;
+    mm.e = mp.e;
+
+    // cached power c = 10^-K bringing m+ into the exponent window [-60, -32]
+    double dk = (-61 - mp.e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (dk - k > 0.0) {
+        ++k;
+    }
+    const unsigned index = (k >> 3) + 1;
+    *K = -(-348 + (int)(index << 3));
+    const diy_fp_t c = { cached_powers_f[index], cached_powers_e[index] };
+
+    const diy_fp_t W = diyMul(diyNormalize(v), c);
+    diy_fp_t Wp = diyMul(mp, c);
+    diy_fp_t Wm = diyMul(mm, c);
+    ++Wm.f;
+    --Wp.f;
+    uint64_t delta = Wp.f - Wm.f;
+
+    // digit generation; Wp is split into integral part p1 and fraction p2
+    const diy_fp_t one = { 1ULL << -Wp.e, Wp.e };
+    const uint64_t wp_w = Wp.f - W.f;
+    uint32_t p1 = Wp.f >> -one.e;
+    uint64_t p2 = Wp.f & (one.f - 1);
+    int kappa = zu32digits(p1);
+    int len = 0;
+    uint64_t rest, ten_kappa, wp_w_scaled;
+    for (;;) {
+        if (kappa > 0) {
+            uint32_t pow10 = pow10_u64[kappa - 1];
+            uint32_t d = p1 / pow10;
+            p1 %= pow10;
+            if (d || len) {
+                digits[len++] = DTOCHAR(d);
+            }
+            --kappa;
+            rest = ((uint64_t)p1 << -one.e) + p2;
+            if (rest <= delta) {
+                *K += kappa;
+                ten_kappa = pow10_u64[kappa] << -one.e;
+                wp_w_scaled = wp_w;
+                break;
+            }
+        } else {
+            p2 *= 10;
+            delta *= 10;
+            uint32_t d = p2 >> -one.e;
+            if (d || len) {
+                digits[len++] = DTOCHAR(d);
+            }
+            p2 &= one.f - 1;
+            --kappa;
+            if (p2 < delta) {
+                *K += kappa;
+                rest = p2;
+                ten_kappa = one.f;
+                wp_w_scaled = -kappa < 20 ? wp_w * pow10_u64[-kappa] : 0;
+                break;
+            }
+        }
+    }
+
+    // round the last digit toward W
+    while (rest < wp_w_scaled && delta - rest >= ten_kappa
+           && (rest + ten_kappa < wp_w_scaled || wp_w_scaled - rest > rest + ten_kappa - wp_w_scaled)) {
+        --digits[len - 1];
+        rest += ten_kappa;
+    }
+    return len;
+}
+
+/**
+ * Exact decimal expansion of a positive, finite double, for the few cases
+ * where the shortest digits can't be rounded to the requested digit count
+ * without knowing what lies beyond them.  The double m * 2^e is expanded
+ * as the integer m * 2^e, or as m * 5^-e scaled by 10^e, in a bignum.
+ *
+ * @param bits raw IEEE-754 encoding of the double
+ * @param digits (out) decimal digits, not terminated; EXACT_MAX_DIGITS long
+ * @param dexp (out) decimal exponent of the leading digit
+ * @return number of digits generated
+ */
+static int exactDigits(uint64_t bits, char *digits, int *dexp)
+{
+    uint32_t big[BIG_WORDS];
+    int nwords;
+    const int biased_e = (bits & DP_EXPONENT_MASK) >> 52;
+    uint64_t m = bits & DP_SIGNIFICAND_MASK;
+    int e;
+    if (biased_e) {
+        m += DP_HIDDEN_BIT;
+        e = biased_e - DP_EXPONENT_BIAS;
+    } else {
+        e = 1 - DP_EXPONENT_BIAS;
+    }
+    big[0] = (uint32_t)m;
+    big[1] = m >> 32;
+    nwords = big[1] ? 2 : 1;
+    // multiply by 2^e or 5^-e
+    int count = e >= 0 ? e : -e;
+    while (count) {
+        const unsigned step = e >= 0 ? (count >= 31 ? 31 : count) : (count >= 13 ? 13 : count);
+        const uint32_t mul = e >= 0 ? 1UL << step : (uint32_t)(pow10_u64[step] >> step); // 5^step
+        uint64_t carry = 0;
+        for (int i = 0; i < nwords; ++i) {
+            uint64_t t = (uint64_t)big[i] * mul + carry;
+            big[i] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry) {
+            big[nwords++] = carry;
+        }
+        count -= step;
+    }
+    // convert to base 10^9, least significant group first
+    uint32_t groups[(EXACT_MAX_DIGITS + 8) / 9];
+    int ngroups = 0;
+    while (nwords) {
+        uint64_t rem = 0;
+        for (int i = nwords - 1; i >= 0; --i) {
+            uint64_t cur = (rem << 32) | big[i];
+            big[i] = cur / 1000000000;
+            rem = cur % 1000000000;
+        }
+        groups[ngroups++] = rem;
+        while (nwords && !big[nwords - 1]) {
+            --nwords;
+        }
+    }
+    char *p = zu32todigits(digits, groups[ngroups - 1], zu32digits(groups[ngroups - 1]));
+    for (int i = ngroups - 2; i >= 0; --i) {
+        p = zu32todigits(p, groups[i], 9);
+    }
+    const int ndigits = p - digits;
+    *dexp = ndigits - 1 + (e < 0 ? e : 0);
+    return ndigits;
+}
+
+/**
+ * Determine whether the shortest digits are too close to a rounding midpoint
+ * at the passed position to be rounded without the exact expansion.
+ *
+ * @param digits shortest digits
+ * @param ndigits number of shortest digits
+ * @param keep number of digits to keep
+ * @return true if digits beyond keep read as 5, 5x, or 49
+ */
+static inline bool nearMidpoint(const char *digits, int ndigits, int keep)
+{
+    if (keep < 0 || keep >= ndigits || ndigits - keep > 2) {
+        return false;
+    }
+    return digits[keep] == '5' || (digits[keep] == '4' && ndigits - keep == 2 && digits[keep + 1] == '9');
+}
+
+/**
+ * Round a string of decimal digits to the passed number of significant
+ * digits.
+ *
+ * @param digits (in/out) decimal digits, most significant first
+ * @param ndigits number of digits in the string
+ * @param keep number of digits to keep; may be <= 0
+ * @param dexp (in/out) decimal exponent of the leading digit
+ * @param exact digits are the exact expansion; round half to even
+ * @return number of digits remaining; 0 if the value rounded to zero
+ */
+static int roundDigits(char *digits, int ndigits, int keep, int *dexp, bool exact)
+{
+    if (keep >= ndigits) {
+        return ndigits;
+    }
+    if (keep < 0) {
+        return 0;
+    }
+    bool up = digits[keep] >= '5';
+    if (exact && digits[keep] == '5') {
+        int i = keep + 1;
+        while (i < ndigits && digits[i] == '0') {
+            ++i;
+        }
+        if (i == ndigits) {
+            // exactly halfway; round to even
+            up = keep && (digits[keep - 1] - '0') & 1;
+        }
+    }
+    ndigits = keep;
+    if (up) {
+        int i = keep - 1;
+        for (; i >= 0 && digits[i] == '9'; --i) {
+            --ndigits; // trailing 9s roll over to zeros we needn't keep
+        }
+        if (i >= 0) {
+            ++digits[i];
+        } else {
+            digits[0] = '1';
+            ndigits = 1;
+            ++*dexp;
+        }
+    }
+    return ndigits;
+}
+
+/**
+ * Print digits in %e style: d.ddde+XX.
+ *
+ * @param buf buffer to print to
+ * @param digits significant digits
+ * @param ndigits number of significant digits; may be less than needed
+ * @param dexp decimal exponent of the leading digit
+ * @param precision number of digits after the decimal point
+ * @param point whether to always print the decimal point
+ * @param e exponent character, 'e' or 'E'
+ * @return pointer to next character in the printed buffer
+ */
+static char *printExp(char *buf, const char *digits, int ndigits, int dexp, int precision, bool point, char e)
+{
+    *buf = ndigits ? digits[0] : '0'; ++buf;
+    if (precision || point) {
+        *buf = '.'; ++buf;
+    }
+    for (int i = 1; i <= precision; ++i) {
+        *buf = i < ndigits ? digits[i] : '0'; ++buf;
+    }
+    *buf = e; ++buf;
+    if (dexp < 0) {
+        *buf = '-';
+        dexp = -dexp;
+    } else {
+        *buf = '+';
+    }
+    ++buf;
+    return zu32todigits(buf, dexp, dexp >= 100 ? 3 : 2);
+}
+
+/**
+ * Print digits in %f style: ddd.ddd.
+ *
+ * @param buf buffer to print to
+ * @param digits significant digits
+ * @param ndigits number of significant digits; may be less than needed
+ * @param dexp decimal exponent of the leading digit
+ * @param precision number of digits after the decimal point
+ * @param point whether to always print the decimal point
+ * @return pointer to next character in the printed buffer
+ */
+static char *printFixed(char *buf, const char *digits, int ndigits, int dexp, int precision, bool point)
+{
+    if (dexp < 0 || !ndigits) {
+        *buf = '0'; ++buf;
+    } else {
+        for (int i = 0; i <= dexp; ++i) {
+            *buf = i < ndigits ? digits[i] : '0'; ++buf;
+        }
+    }
+    if (precision || point) {
+        *buf = '.'; ++buf;
+    }
+    for (int i = 1; i <= precision; ++i) {
+        int pos = dexp + i;
+        *buf = pos >= 0 && pos < ndigits ? digits[pos] : '0'; ++buf;
+    }
+    return buf;
+}
+
+/**
+ * Print a double using the shortest round-trip digits.  The caller is
+ * responsible for ensuring the buffer is FLOAT_BUF_SIZE.
+ *
+ * %e and %f are printed with the passed precision, rounding or zero-
+ * extending the shortest digits.  %g with a precision follows C99: that many
+ * significant digits and no trailing zeros.  %g without one prints the
+ * shortest string that reads back as the same double.
+ *
+ * @param buf buffer to print to
+ * @param f value to print
+ * @param width 1-based width of the whole field
+ * @param precision precision, or ZS_PRECISION_UNSPECIFIED
+ * @param flags sign and padding flags
+ * @param specifier one of 'f', 'F', 'e', 'E', 'g', 'G', 'a', 'A'
+ * @return pointer to next character in the printed buffer
+ */
+static char *zdtoa(char *buf, double f, unsigned width, int precision, zs_flags_t flags, char specifier)
+{
+    uint64_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    const bool negative = bits >> 63;
+    bits &= ~(1ULL << 63);
+    char field[FLOAT_BUF_SIZE];
+    char *p = field;
+    if (negative) {
+        *p = '-'; ++p;
+    } else if (flags.sign == zs_always_sign) {
+        *p = '+'; ++p;
+    } else if (flags.sign == zs_sign_or_space) {
+        *p = ' '; ++p;
+    }
+    char *body = p;
+
+    if ((bits & DP_EXPONENT_MASK) == DP_EXPONENT_MASK) {
+        const char *s = (bits & DP_SIGNIFICAND_MASK) ? "NAN" : "INF";
+        if (*s == 'N') {
+            p = body = field; // no sign for NAN
+        }
+        memcpy(p, s, 3);
+        p += 3;
+        flags.zeropad = 0;
+    } else {
+        char shortest[SHORTEST_MAX_DIGITS + 1];
+        char exact[EXACT_MAX_DIGITS];
+        char *digits = shortest;
+        int ndigits = 1, K = 0;
+        if (bits) {
+            ndigits = grisu2(bits, digits, &K);
+        } else {
+            digits[0] = '0';
+        }
+        int dexp = K + ndigits - 1; // decimal exponent of the leading digit
+        const bool upper = specifier == 'E' || specifier == 'G' || specifier == 'A' || specifier == 'F';
+        const bool general = specifier == 'g' || specifier == 'G';
+        const bool point = flags.altForm;
+        if (precision > FLOAT_MAX_PRECISION) {
+            precision = FLOAT_MAX_PRECISION;
+        }
+        int P = SHORTEST_MAX_DIGITS; // %g significant digits
+        bool fixed;
+        if (general && precision == ZS_PRECISION_UNSPECIFIED) {
+            fixed = dexp >= -4 && dexp < P;
+        } else {
+            if (general) {
+                P = precision ? precision : 1;
+            } else if (precision == ZS_PRECISION_UNSPECIFIED) {
+                precision = DEFAULT_PRECISION;
+            }
+            fixed = (specifier == 'f' || specifier == 'F') && dexp < FLOAT_MAX_FIXED;
+            int keep = general ? P : fixed ? dexp + 1 + precision : precision + 1;
+            if (bits) {
+                // Shortest digits round correctly to keep digits unless more
+                // than DBL_DIG are wanted or they sit right at a midpoint.
+                // A subnormal has fewer than DBL_DIG faithful digits, so
+                // only its shortest ones can be kept, not padded.
+                const bool subnormal = !(bits & DP_EXPONENT_MASK);
+                const bool use_exact = keep > DBL_DIG || (subnormal && keep > ndigits) || nearMidpoint(digits, ndigits, keep);
+                if (use_exact) {
+                    digits = exact;
+                    ndigits = exactDigits(bits, digits, &dexp);
+                    if (fixed) {
+                        keep = dexp + 1 + precision;
                     }
-                    zftoa(tmp, val, width, precision == PRECISION_UNSPECIFIED ? DEFAULT_PRECISION : precision, flags);
                 }
-                tok = tmp;
-            } else if (*spec == 'p') {
-                void *val = va_arg(ap, void *);
-                zllxtoa(tmp, (unsigned long long)val, width, flags);
-                tok = tmp;
-            } else if (*spec == 's') {
-                tok = va_arg(ap, const char *);
-            } else if (*spec == 'c') {
-                tmp[0] = va_arg(ap, int);
-                tmp[1] = '\0';
-                tok = tmp;
+                ndigits = roundDigits(digits, ndigits, keep, &dexp, use_exact);
+            }
+            if (general) {
+                // C99: fixed notation when -4 <= X < P
+                fixed = dexp >= -4 && dexp < P;
             }
-        } else if (strchr(escape + 1, 'n')) {
-            src = spec + 1;
-            *va_arg(ap, int *) = n - remain;
-        } else {
-            src = escape + 1;
         }
-        if (tok) {
-            toklen = strlen(tok);
-            len += toklen;
-            if (toklen > remain) {
-                toklen = remain;
+        if (general) {
+            while (ndigits > 1 && digits[ndigits - 1] == '0') {
+                --ndigits;
+            }
+            int fraction = (point && precision != ZS_PRECISION_UNSPECIFIED ? P : ndigits) - 1;
+            if (fixed) {
+                fraction -= dexp;
+                p = printFixed(p, digits, ndigits, dexp, fraction > 0 ? fraction : 0, point);
+            } else {
+                p = printExp(p, digits, ndigits, dexp, fraction, point, upper ? 'E' : 'e');
             }
-            remain -= toklen;
-            ZCOAP_MEMCPY(dest, tok, toklen);
-            dest += toklen;
+        } else if (fixed) {
+            p = printFixed(p, digits, ndigits, dexp, precision, point);
+        } else {
+            p = printExp(p, digits, ndigits, dexp, precision, point, upper ? 'E' : 'e');
+        }
+    }
+
+    // pad the field to width, zeros going between the sign and the digits
+    size_t len = p - field;
+    if (width > FLOAT_BUF_SIZE - 1) {
+        width = FLOAT_BUF_SIZE - 1;
+    }
+    if (width > len) {
+        size_t pad = width - len;
+        if (flags.zeropad) {
+            size_t signlen = body - field;
+            memcpy(buf, field, signlen);
+            memset(buf + signlen, '0', pad);
+            memcpy(buf + signlen + pad, body, len - signlen);
+        } else {
+            memset(buf, ' ', pad);
+            memcpy(buf + pad, field, len);
+        }
+        len = width;
+    } else {
+        memcpy(buf, field, len);
+    }
+    buf += len;
+    *buf = '\0';
+    return buf;
+}
+
+#endif /* ZSNPRINTF_FLOAT_SHORTEST */
+
+#ifdef SIZE_MAX
+#if SIZE_MAX <= UINT_MAX
+#define LENGTH_SIZE_T zs_length_int
+#elif SIZE_MAX == ULONG_MAX
+#define LENGTH_SIZE_T zs_length_long
+#elif SIZE_MAX == ULLONG_MAX
+#define LENGTH_SIZE_T zs_length_long_long
+#else
+#error unsupported SIZE_MAX
+#endif
+#else
+#define LENGTH_SIZE_T zs_length_int
+#endif /* SIZE_MAX */
+
+#if UINT_MAX >= UINT32_MAX
+#define LENGTH_INT32_T zs_length_int
+#else
+#define LENGTH_INT32_T zs_length_long
+#endif
+
+#ifdef PTRDIFF_MAX
+#if PTRDIFF_MAX <= INT_MAX
+#define LENGTH_PTRDIFF_T zs_length_int
+#elif PTRDIFF_MAX == LONG_MAX
+#define LENGTH_PTRDIFF_T zs_length_long
+#elif PTRDIFF_MAX == LLONG_MAX
+#define LENGTH_PTRDIFF_T zs_length_long_long
+#else
+#error unsupported PTRDIFF_MAX
+#endif
+#else
+#define LENGTH_PTRDIFF_T zs_length_int
+#endif /* PTRDIFF_MAX */
+
+typedef enum char_class_e {
+    cc_other,
+    cc_flag, // '0' is classed as a flag; it's also a digit after the flags
+    cc_digit,
+    cc_dot,
+    cc_star,
+    cc_length,
+    cc_spec,
+} char_class_t;
+
+static const uint8_t char_class[256] = {
+    ['-'] = cc_flag, ['+'] = cc_flag, [' '] = cc_flag, ['#'] = cc_flag, ['0'] = cc_flag,
+    ['1'] = cc_digit, ['2'] = cc_digit, ['3'] = cc_digit, ['4'] = cc_digit, ['5'] = cc_digit,
+    ['6'] = cc_digit, ['7'] = cc_digit, ['8'] = cc_digit, ['9'] = cc_digit,
+    ['.'] = cc_dot,
+    ['*'] = cc_star,
+    ['h'] = cc_length, ['l'] = cc_length, ['L'] = cc_length, ['j'] = cc_length,
+    ['z'] = cc_length, ['t'] = cc_length,
+    ['d'] = cc_spec, ['i'] = cc_spec, ['u'] = cc_spec, ['x'] = cc_spec, ['X'] = cc_spec,
+    ['o'] = cc_spec, ['f'] = cc_spec, ['F'] = cc_spec, ['e'] = cc_spec, ['E'] = cc_spec,
+    ['g'] = cc_spec, ['G'] = cc_spec, ['a'] = cc_spec, ['A'] = cc_spec, ['s'] = cc_spec,
+    ['c'] = cc_spec, ['p'] = cc_spec, ['n'] = cc_spec, ['%'] = cc_spec,
+};
+
+#define CLASS(_c) (char_class[(unsigned char)(_c)])
+#define MAX_PARSED_FIELD 100000 // caps parsed width and precision
+
+#if ZSNPRINTF_CUSTOM
+// conversions added with zspec_register, by specifier
+static zspec_handler_t handlers[128];
+#endif
+
+/**
+ * @param c format character
+ * @return handler registered for c as a specifier, or NULL if none
+ */
+static inline zspec_handler_t customHandler(char c)
+{
+#if ZSNPRINTF_CUSTOM
+    return (unsigned char)c < sizeof(handlers) / sizeof(*handlers) ? handlers[(unsigned char)c] : NULL;
+#else
+    (void)c;
+    return NULL;
+#endif
+}
+
+/**
+ * Add a conversion for a specifier of your own, e.g. 'I' for addresses, or
+ * remove one.  The handler takes its own arguments and prints straight into
+ * the output, so any type can be formatted without a temporary string.
+ * Handlers are global; register them at startup, before formatting on other
+ * threads.
+ *
+ * Custom conversions work with zvsnprintf, zvsnprintf_trunc, zvcbprintf and
+ * compiled formats.  zvcapture runs the handler at capture time and stores
+ * its output.  Their arguments aren't typed, so zsnprintf_args and
+ * zsnprintf_batch leave them out of the output, and zspec_parse rejects
+ * them.
+ *
+ * @param specifier ASCII specifier character; built-in specifiers and
+ *        characters meaningful inside a conversion, such as flags, digits
+ *        and length modifiers, can't be used
+ * @param handler conversion to run, or NULL to remove the specifier; a
+ *        format compiled while it was registered then prints nothing for
+ *        it, and takes no argument for it
+ * @return true on success, false if specifier can't be used, or in a build
+ *         without ZSNPRINTF_CUSTOM
+ */
+bool zspec_register(char specifier, zspec_handler_t handler)
+{
+#if ZSNPRINTF_CUSTOM
+    const unsigned char c = specifier;
+    if (!c || c >= sizeof(handlers) / sizeof(*handlers) || CLASS(c) != cc_other) {
+        return false;
+    }
+    handlers[c] = handler;
+    return true;
+#else
+    (void)specifier; (void)handler;
+    return false;
+#endif
+}
+
+/**
+ * Parse an unsigned decimal field of a conversion specification.
+ *
+ * @param src (in/out) position in the format string; advanced past the digits
+ * @return parsed value, saturated to MAX_PARSED_FIELD
+ */
+static inline int scanDecimal(const char **src)
+{
+    const char *p = *src;
+    int val = 0;
+    while (CLASS(*p) == cc_digit || *p == '0') {
+        if (val < MAX_PARSED_FIELD) {
+            val = 10 * val + (*p - '0');
+        }
+        ++p;
+    }
+    *src = p;
+    return val;
+}
+
+/**
+ * Parse the conversion specification introduced by the passed escape in a
+ * single left-to-right pass: flags, width, precision, length, specifier.
+ *
+ * @param escape pointer to the '%' character introducing the conversion
+ * @param spec (out) parsed conversion; specifier is '\0' if none was found
+ * @return pointer to the format character following the conversion
+ */
+static const char *scanSpec(const char *escape, zspec_t *spec)
+{
+    const char *p = escape + 1;
+    *spec = (zspec_t){ .precision = ZS_PRECISION_UNSPECIFIED };
+    for (; CLASS(*p) == cc_flag; ++p) {
+        switch (*p) {
+            case '-': spec->flags.leftAlign = 1; break; // only honored where padding is emitted
+            case '+': spec->flags.sign = zs_always_sign; break;
+            case ' ': if (spec->flags.sign != zs_always_sign) { spec->flags.sign = zs_sign_or_space; } break;
+            case '#': spec->flags.altForm = 1; break; // '#' flag not currently supported
+            case '0': spec->flags.zeropad = 1; break;
         }
     }
-    {
-        size_t toklen = strlen(src);
-        len += toklen;
-        if (toklen >= remain) {
-            toklen = remain;
+    if (CLASS(*p) == cc_star) {
+        // special case; grab width from args
+        spec->width = ZS_ARG_SPECIFIED;
+        ++p;
+    } else if (CLASS(*p) == cc_digit) {
+        spec->width = scanDecimal(&p);
+    }
+    if (CLASS(*p) == cc_dot) {
+        ++p;
+        if (CLASS(*p) == cc_star) {
+            // special case; grab precision from args
+            spec->precision = ZS_ARG_SPECIFIED;
+            ++p;
+        } else if (CLASS(*p) == cc_digit || *p == '0') {
+            spec->precision = scanDecimal(&p);
         }
-        remain -= toklen;
-        ZCOAP_MEMCPY(dest, src, toklen);
-        dest += toklen;
-        if (remain) {
-            *dest = '\0';
-        } else if (n) {
-            buf[n - 1] = '\0';
+    }
+    if (CLASS(*p) == cc_length) {
+        switch (*p) {
+            case 'h': spec->length = zs_length_int; if (p[1] == 'h') { ++p; } break;
+            case 'l':
+                if (p[1] == 'l') {
+                    spec->length = zs_length_long_long;
+                    ++p;
+                } else {
+                    spec->length = zs_length_long;
+                }
+                break;
+            case 'L': spec->length = zs_length_long; break;
+            case 'j': spec->length = zs_length_long_long; break;
+            case 'z': spec->length = LENGTH_SIZE_T; break;
+            case 't': spec->length = LENGTH_PTRDIFF_T; break;
         }
+        ++p;
     }
-    return len;
+    if (CLASS(*p) != cc_spec && !customHandler(*p)) {
+        // not a conversion; drop the '%'
+        spec->specifier = '\0';
+        return escape + 1;
+    }
+    if (ZSNPRINTF_ADDRESSES && *p == 'p') {
+        // %pI4, %pI6, %pM or %pU, where the IP version or the letter stands
+        // for the specifier; other characters after a %p are literal text
+        if (p[1] == 'I' && (p[2] == '4' || p[2] == '6')) {
+            p += 2;
+        } else if (p[1] == 'M' && p[2] == '8') {
+            spec->precision = 8; // EUI-64
+            spec->specifier = 'M';
+            return p + 3;
+        } else if (p[1] == 'M' || p[1] == 'U') {
+            ++p;
+        }
+    }
+    spec->specifier = *p;
+    return p + 1;
 }
 
-size_t zsnprintf(char *buf, size_t n, const char *fmt, ...)
+/**
+ * Pick where to convert a token: straight into the destination when there's
+ * room for the worst-case conversion, otherwise into the passed temporary.
+ *
+ * @param out output state
+ * @param tmp temporary buffer of CONVERT_BUF_SIZE bytes
+ * @return buffer to convert into
+ */
+static HOT_INLINE char *reserve(zout_t *out, char *tmp)
 {
-    va_list ap;
-    va_start(ap, fmt);
-    size_t len = zvsnprintf(buf, n, fmt, ap);
-    va_end(ap);
-    return len;
+    if (UNLIKELY(out->remain < CONVERT_BUF_SIZE) && out->sink) {
+        drain(out);
+    }
+    return LIKELY(out->remain >= CONVERT_BUF_SIZE) ? out->dest : tmp;
+}
+
+/**
+ * Account for a token converted into the buffer returned by reserve.
+ *
+ * @param out output state
+ * @param tok start of the converted token
+ * @param end end of the converted token
+ */
+static HOT_INLINE void commit(zout_t *out, const char *tok, const char *end)
+{
+    if (LIKELY(tok == out->dest)) {
+        size_t toklen = end - tok;
+        out->len += toklen;
+        out->remain -= toklen;
+        out->dest += toklen;
+    } else {
+        emit(out, tok, end - tok);
+    }
+}
+
+typedef enum arg_class_e {
+    arg_none,
+    arg_int,
+    arg_long,
+    arg_long_long,
+    arg_double,
+    arg_long_double,
+    arg_ptr,
+    arg_str,
+} arg_class_t;
+
+/**
+ * One fetched argument; the member used is given by argClass.
+ */
+typedef union zval_u {
+    unsigned u;
+    long unsigned lu;
+    long long unsigned llu;
+    double d;
+    long double ld;
+    void *p;
+    const char *s;
+} zval_t;
+
+/**
+ * @param spec parsed conversion specification
+ * @return type of the argument the conversion consumes
+ */
+static arg_class_t argClass(const zspec_t *spec)
+{
+    switch (spec->specifier) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+            return   spec->length == zs_length_int ? arg_int
+                   : spec->length == zs_length_long ? arg_long
+                   : arg_long_long;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            return spec->length == zs_length_long ? arg_long_double : arg_double;
+        case 'c': return arg_int;
+        case 'p': case 'n': case '4': case '6': case 'M': case 'U': return arg_ptr;
+        case 's': return arg_str;
+        default: return arg_none;
+    }
+}
+
+/**
+ * Fetch the value for a single conversion.
+ *
+ * @param cls argument type, from argClass
+ * @param ap argument list to fetch from
+ * @param val (out) fetched value
+ */
+static HOT_INLINE void fetch(arg_class_t cls, va_list *ap, zval_t *val)
+{
+    switch (cls) {
+        case arg_int: val->u = va_arg(*ap, int); break;
+        case arg_long: val->lu = va_arg(*ap, long int); break;
+        case arg_long_long: val->llu = va_arg(*ap, long long int); break;
+        case arg_double: val->d = va_arg(*ap, double); break;
+        case arg_long_double: val->ld = va_arg(*ap, long double); break;
+        case arg_ptr: val->p = va_arg(*ap, void *); break;
+        case arg_str: val->s = va_arg(*ap, const char *); break;
+        case arg_none: break;
+    }
+}
+
+/**
+ * Store an integer in the zval_t member the spec's length reads, sign- or
+ * zero-extended per the specifier as printf's argument promotion would.
+ */
+static inline void intValue(const zspec_t *spec, int64_t sval, uint64_t uval, zval_t *val)
+{
+    const uint64_t x = spec->specifier == 'd' || spec->specifier == 'i' ? (uint64_t)sval : uval;
+    if (spec->length == zs_length_int) {
+        val->u = x;
+    } else if (spec->length == zs_length_long) {
+        val->lu = x;
+    } else {
+        val->llu = x;
+    }
+}
+
+/**
+ * @param n value to measure
+ * @return number of decimal digits needed to print n
+ */
+static inline unsigned zu64digits(uint64_t n)
+{
+    if (n <= UINT32_MAX) {
+        return zu32digits(n);
+    }
+    return n < 10000000000u ? 10 : 10 + zu32digits(n / 10000000000u);
+}
+
+/**
+ * Length of an integer printed by our converters: an optional sign, then the
+ * digits, padded to the width, with the padding capped at max_width.
+ *
+ * @param ndigits number of digits
+ * @param width 1-based width for printf
+ * @param max_width largest width the converter pads to
+ * @param sign whether a sign or space is printed
+ * @return printed length
+ */
+static inline size_t intLength(unsigned ndigits, unsigned width, unsigned max_width, bool sign)
+{
+    if (width > max_width) {
+        width = max_width;
+    }
+    return sign + (width > ndigits ? width : ndigits);
+}
+
+/**
+ * Length of a decimal conversion, mirroring the width limits of the
+ * zi16toa..zu64toa converter zitoa, zltoa or zlltoa select for the size.
+ *
+ * @param bits argument, zero-extended
+ * @param size size of the argument's type
+ * @param isSigned true for %d/%i
+ * @param width 1-based width for printf
+ * @param flags flags of the conversion
+ * @return printed length
+ */
+static size_t decLength(uint64_t bits, int_size_t size, bool isSigned, unsigned width, zs_flags_t flags)
+{
+    if (!isSigned) {
+        if (size == ZS16) {
+            return intLength(zu32digits((uint16_t)bits), width, 5, false);
+        } else if (size == ZS32 || bits <= UINT32_MAX) {
+            return intLength(zu32digits((uint32_t)bits), width, 10, false);
+        }
+        return intLength(zu64digits(bits), width, 21, false);
+    }
+    int64_t n =   size == ZS16 ? (int16_t)bits
+                : size == ZS32 ? (int32_t)bits
+                : (int64_t)bits;
+    const bool sign = n < 0 || flags.sign != zs_auto_sign;
+    const uint64_t absn = n < 0 ? -(uint64_t)n : (uint64_t)n;
+    if (size == ZS16) {
+        return intLength(zu32digits(absn), width, 5, sign);
+    } else if (n >= INT32_MIN && n <= INT32_MAX) {
+        return intLength(zu32digits(absn), width, 10, sign);
+    }
+    return intLength(zu64digits(absn), width, 20, sign);
+}
+
+/**
+ * Find how much of a %s argument to print, scanning no further than the
+ * precision, and in zsnprintf_trunc no further than fits.  A precision lets
+ * the argument be an unterminated array, e.g. a field of a network packet.
+ *
+ * @param out output state
+ * @param str argument
+ * @param width field width, with any '*' already resolved; a shorter string
+ *        is always measured exactly, so its padding is right
+ * @param precision precision, with any '.*' already resolved
+ * @return number of characters to print
+ */
+static inline size_t strLength(const zout_t *out, const char *str, unsigned width, unsigned precision)
+{
+    const bool bounded = precision <= INT_MAX; // a negative '.*' reads as none
+    size_t max = bounded ? precision : SIZE_MAX;
+    const size_t fits = out->remain > width ? out->remain : width;
+    if (out->stop && fits < max) {
+        max = fits;
+    } else if (!bounded) {
+        return strlen(str);
+    }
+    // memchr is the library's word-at-a-time or vector scan, and reads no
+    // further than max
+    const char *nul = memchr(str, '\0', max);
+    return nul ? (size_t)(nul - str) : max;
+}
+
+/**
+ * Emit count copies of a character, e.g. width padding.  Once a buffer is
+ * full the rest is only counted.
+ *
+ * @param out output state
+ * @param c character to emit
+ * @param count number of copies
+ */
+static void fill(zout_t *out, char c, size_t count)
+{
+    char chunk[16];
+    memset(chunk, c, sizeof(chunk));
+    while (count) {
+        if (!out->remain && !out->sink) {
+            out->len += count;
+            return;
+        }
+        const size_t len = count < sizeof(chunk) ? count : sizeof(chunk);
+        emit(out, chunk, len);
+        count -= len;
+    }
+}
+
+/**
+ * Account for a conversion that falls entirely past the end of the buffer,
+ * computing its length without generating digits.
+ *
+ * @param out output state with no room left
+ * @param spec parsed conversion specification
+ * @param width field width, with any '*' already resolved
+ * @param precision precision, with any '.*' already resolved
+ * @param v value fetched for the argClass of spec
+ * @return true if measured, false if the conversion must run to find its
+ *         length
+ */
+static bool measure(zout_t *out, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    const char specifier = spec->specifier;
+    const int_size_t size =   spec->length == zs_length_int ? ZS_INT
+                            : spec->length == zs_length_long ? ZS_LONG
+                            : ZS64;
+    const uint64_t bits =   spec->length == zs_length_int ? v->u
+                          : spec->length == zs_length_long ? v->lu
+                          : v->llu;
+    size_t len;
+    if (specifier == 'd' || specifier == 'i' || specifier == 'u') {
+        len = decLength(bits, size, specifier != 'u', width, spec->flags);
+    } else if (specifier == 'x' || specifier == 'X') {
+        len = intLength(zx64digits(bits, 4), width, 16, false);
+    } else if (specifier == 'o') {
+        len = ZSNPRINTF_OCTAL ? intLength(zx64digits(bits, 3), width, 22, false) : 0;
+    } else if (specifier == 'p') {
+        len = intLength(zx64digits((uintptr_t)v->p, 4), width, 16, false);
+    } else if (specifier == 's' || specifier == 'c') {
+        len = specifier == 's' ? strLength(out, v->s, width, precision) : 1;
+        len = len < width ? width : len;
+    } else if (specifier == '%') {
+        len = 1;
+    } else {
+        return false;
+    }
+    out->len += len;
+    return true;
+}
+
+/**
+ * Converter for the built-in specifiers sharing one conversion routine.
+ * Each prints into dst, from reserve, and returns the end of its output, or
+ * emits the output itself and returns NULL.
+ *
+ * @param out output state
+ * @param dst buffer to convert into, from reserve
+ * @param spec parsed conversion specification
+ * @param width field width, with any '*' already resolved
+ * @param precision precision, with any '.*' already resolved
+ * @param v value fetched for the argClass of spec
+ * @return end of the output in dst, or NULL if already emitted
+ */
+typedef char *(*converter_t)(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v);
+
+static char *convDecimal(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)out; (void)precision;
+    switch (spec->length) {
+        case zs_length_int: return zitoa(dst, v->u, width, spec->flags);
+        case zs_length_long: return zltoa(dst, v->lu, width, spec->flags);
+        default: return zlltoa(dst, v->llu, width, spec->flags);
+    }
+}
+
+static char *convUnsigned(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)out; (void)precision;
+    switch (spec->length) {
+        case zs_length_int: return zutoa(dst, v->u, width, spec->flags);
+        case zs_length_long: return zultoa(dst, v->lu, width, spec->flags);
+        default: return zulltoa(dst, v->llu, width, spec->flags);
+    }
+}
+
+static char *convHex(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)out; (void)precision;
+    if (spec->specifier == 'X') {
+        switch (spec->length) {
+            case zs_length_int: return zXtoa(dst, v->u, width, spec->flags);
+            case zs_length_long: return zlXtoa(dst, v->lu, width, spec->flags);
+            default: return zllXtoa(dst, v->llu, width, spec->flags);
+        }
+    }
+    switch (spec->length) {
+        case zs_length_int: return zxtoa(dst, v->u, width, spec->flags);
+        case zs_length_long: return zlxtoa(dst, v->lu, width, spec->flags);
+        default: return zllxtoa(dst, v->llu, width, spec->flags);
+    }
+}
+
+static char *convOctal(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)out; (void)precision;
+#if ZSNPRINTF_OCTAL
+    switch (spec->length) {
+        case zs_length_int: return zotoa(dst, v->u, width, spec->flags);
+        case zs_length_long: return zlotoa(dst, v->lu, width, spec->flags);
+        default: return zllotoa(dst, v->llu, width, spec->flags);
+    }
+#else
+    (void)dst; (void)spec; (void)width; (void)v;
+    return NULL;
+#endif
+}
+
+static char *convFloating(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)out;
+    const zs_length_t length = spec->length;
+    const char specifier = spec->specifier;
+#if ZSNPRINTF_FLOAT_BACKEND == ZSNPRINTF_FLOAT_SHORTEST
+    double val = length == zs_length_long ? v->ld : v->d;
+    return zdtoa(dst, val, width, precision, spec->flags, specifier);
+#else
+    zs_flags_t flags = spec->flags;
+    if (ZSNPRINTF_LONG_DOUBLE && length == zs_length_long) {
+        long double val = v->ld;
+        if (specifier == 'e' || specifier == 'a') {
+            flags.exp = zs_exp_e;
+        } else if (specifier == 'E' || specifier == 'A') {
+            flags.exp = zs_exp_E;
+        } else  if (specifier == 'g' || specifier == 'G') {
+            long double absv = fabsl(val);
+            if (absv < GMINF || absv > GMAXF) {
+                if (specifier == 'g') {
+                    flags.exp = zs_exp_e;
+                } else {
+                    flags.exp = zs_exp_E;
+                }
+            }
+        }
+        return zftoal(dst, val, width, precision == (unsigned)ZS_PRECISION_UNSPECIFIED ? DEFAULT_PRECISION : precision, flags);
+    }
+    double val = length == zs_length_long ? v->ld : v->d;
+    if (specifier == 'e' || specifier == 'a') {
+        flags.exp = zs_exp_e;
+    } else if (specifier == 'E' || specifier == 'A') {
+        flags.exp = zs_exp_E;
+    } else  if (specifier == 'g' || specifier == 'G') {
+        double absv = fabs(val);
+        if (absv < GMINF || absv > GMAXF) {
+            if (specifier == 'g') {
+                flags.exp = zs_exp_e;
+            } else {
+                flags.exp = zs_exp_E;
+            }
+        }
+    }
+    return zftoa(dst, val, width, precision == (unsigned)ZS_PRECISION_UNSPECIFIED ? DEFAULT_PRECISION : precision, flags);
+#endif
+}
+
+static char *convPointer(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)out; (void)precision;
+    void *val = v->p;
+    return zllxtoa(dst, (unsigned long long)val, width, spec->flags);
+}
+
+/**
+ * Emit a token space-padded to the field width, on the right with the '-'
+ * flag, otherwise on the left.
+ *
+ * @param out output state
+ * @param str token
+ * @param len length of the token
+ * @param width field width
+ * @param flags conversion flags
+ */
+static void emitPadded(zout_t *out, const char *str, size_t len, unsigned width, zs_flags_t flags)
+{
+    const size_t padlen = width > len ? width - len : 0;
+    if (!flags.leftAlign) {
+        fill(out, ' ', padlen);
+    }
+    emit(out, str, len);
+    if (flags.leftAlign) {
+        fill(out, ' ', padlen);
+    }
+}
+
+static char *convString(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)dst;
+    const char c = v->u;
+    const char *str = spec->specifier == 's' ? v->s : &c;
+    const size_t len = spec->specifier == 's' ? strLength(out, str, width, precision) : 1;
+    emitPadded(out, str, len, width, spec->flags);
+    return NULL;
+}
+
+static char *convCount(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)dst; (void)spec; (void)width; (void)precision;
+    *(int *)v->p = out->len;
+    return NULL;
+}
+
+static char *convPercent(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)dst; (void)spec; (void)width; (void)precision; (void)v;
+    emit(out, "%", 1);
+    return NULL;
+}
+
+#define ADDR_BUF_SIZE sizeof("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff")
+#define MAC_DEFAULT_BYTES 6
+#define MAC_CHUNK_BYTES 16 // bytes of %pM output staged at a time
+
+#if ZSNPRINTF_ADDRESSES
+
+/**
+ * Print an IPv4 address in dotted-quad form.
+ *
+ * @param buf buffer of at least sizeof("255.255.255.255") - 1 characters
+ * @param a 4 bytes of address, in network order
+ * @return pointer to next character in the printed buffer
+ */
+static char *putIPv4(char *buf, const uint8_t *a)
+{
+    for (unsigned i = 0; i < 4; ++i) {
+        unsigned b = a[i];
+        if (b >= 100) {
+            *buf++ = DTOCHAR(b / 100);
+            buf = putPair(buf, b % 100);
+        } else if (b >= 10) {
+            buf = putPair(buf, b);
+        } else {
+            *buf++ = DTOCHAR(b);
+        }
+        *buf++ = '.';
+    }
+    return buf - 1;
+}
+
+/**
+ * Print an IPv6 address in the canonical form of RFC 5952: lowercase hex
+ * groups without leading zeros, the longest run of two or more zero groups
+ * (the first, if tied) shortened to "::", and IPv4-mapped addresses in
+ * mixed notation, e.g. "::ffff:192.0.2.1".
+ *
+ * @param buf buffer of at least ADDR_BUF_SIZE - 1 characters
+ * @param a 16 bytes of address, in network order
+ * @return pointer to next character in the printed buffer
+ */
+static char *putIPv6(char *buf, const uint8_t *a)
+{
+    unsigned group[8];
+    for (unsigned i = 0; i < 8; ++i) {
+        group[i] = (unsigned)a[2 * i] << 8 | a[2 * i + 1];
+    }
+    unsigned zeros = 8; // start of the run to shorten; 8 if none
+    unsigned nzeros = 1;
+    for (unsigned i = 0; i < 8;) {
+        unsigned j = i;
+        while (j < 8 && !group[j]) {
+            ++j;
+        }
+        if (j - i > nzeros) {
+            zeros = i;
+            nzeros = j - i;
+        }
+        i = j + 1;
+    }
+    if (zeros == 0 && nzeros == 5 && group[5] == 0xFFFF) {
+        ZCOAP_MEMCPY(buf, "::ffff:", sizeof("::ffff:") - 1);
+        return putIPv4(buf + sizeof("::ffff:") - 1, a + 12);
+    }
+    for (unsigned i = 0; i < 8; ++i) {
+        if (i == zeros) {
+            *buf++ = ':';
+            *buf++ = ':';
+            i += nzeros - 1;
+            continue;
+        }
+        if (i && i != zeros + nzeros) {
+            *buf++ = ':';
+        }
+        for (unsigned shift = 4 * zx64digits(group[i], 4); shift;) {
+            shift -= 4;
+            *buf++ = hex_digits[0][group[i] >> shift & 0xF];
+        }
+    }
+    return buf;
+}
+
+static char *convAddr(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)dst; (void)precision;
+    char tmp[ADDR_BUF_SIZE];
+    const char *end = spec->specifier == '4' ? putIPv4(tmp, v->p) : putIPv6(tmp, v->p);
+    emitPadded(out, tmp, end - tmp, width, spec->flags);
+    return NULL;
+}
+
+static char *convUUID(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)dst; (void)precision;
+    // 8-4-4-4-12 hex digits
+    char hex[32];
+    char tmp[sizeof("01234567-89ab-cdef-0123-456789abcdef")];
+    zhex8(hex, v->p, false);
+    zhex8(hex + 16, (const uint8_t *)v->p + 8, false);
+    ZCOAP_MEMCPY(tmp, hex, 8);
+    tmp[8] = '-';
+    ZCOAP_MEMCPY(tmp + 9, hex + 8, 4);
+    tmp[13] = '-';
+    ZCOAP_MEMCPY(tmp + 14, hex + 12, 4);
+    tmp[18] = '-';
+    ZCOAP_MEMCPY(tmp + 19, hex + 16, 4);
+    tmp[23] = '-';
+    ZCOAP_MEMCPY(tmp + 24, hex + 20, 12);
+    emitPadded(out, tmp, sizeof(tmp) - 1, width, spec->flags);
+    return NULL;
+}
+
+static char *convMAC(zout_t *out, char *dst, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    (void)dst;
+    // precision is the number of bytes: 6 for a MAC, 8 for an EUI-64
+    const size_t nbytes = precision > INT_MAX ? MAC_DEFAULT_BYTES : precision;
+    const size_t len = nbytes ? 3 * nbytes - 1 : 0;
+    const size_t padlen = width > len ? width - len : 0;
+    if (!spec->flags.leftAlign) {
+        fill(out, ' ', padlen);
+    }
+    const uint8_t *src = v->p;
+    char tmp[3 * MAC_CHUNK_BYTES];
+    for (size_t i = 0; i < nbytes;) {
+        char *p = tmp;
+        for (size_t k = 0; k < MAC_CHUNK_BYTES && i < nbytes; ++k, ++i) {
+            *p++ = hex_digits[0][src[i] >> 4];
+            *p++ = hex_digits[0][src[i] & 0xF];
+            *p++ = ':';
+        }
+        emit(out, tmp, p - tmp - (i == nbytes));
+    }
+    if (spec->flags.leftAlign) {
+        fill(out, ' ', padlen);
+    }
+    return NULL;
+}
+
+#endif /* ZSNPRINTF_ADDRESSES */
+
+// built-in conversions by specifier; the cc_spec characters, and '4', '6',
+// 'M' and 'U' standing for %pI4, %pI6, %pM and %pU
+static const converter_t converters[128] = {
+    ['d'] = convDecimal, ['i'] = convDecimal, ['u'] = convUnsigned,
+    ['x'] = convHex, ['X'] = convHex, ['o'] = convOctal,
+    ['f'] = convFloating, ['F'] = convFloating, ['e'] = convFloating, ['E'] = convFloating,
+    ['g'] = convFloating, ['G'] = convFloating, ['a'] = convFloating, ['A'] = convFloating,
+    ['p'] = convPointer, ['s'] = convString, ['c'] = convString, ['n'] = convCount,
+    ['%'] = convPercent,
+#if ZSNPRINTF_ADDRESSES
+    ['4'] = convAddr, ['6'] = convAddr, ['M'] = convMAC, ['U'] = convUUID,
+#endif
+};
+
+/**
+ * Body of convertValue.
+ */
+static HOT_INLINE void convertSpec(zout_t *out, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+    const converter_t conv = converters[(unsigned char)spec->specifier];
+    if (UNLIKELY(!conv)) {
+        // a custom specifier whose handler was removed after the format was
+        // compiled; print nothing
+        return;
+    }
+    if (UNLIKELY(!out->remain) && !out->sink && measure(out, spec, width, precision, v)) {
+        return;
+    }
+    char tmp[CONVERT_BUF_SIZE];
+    char *dst = reserve(out, tmp);
+    char *end = conv(out, dst, spec, width, precision, v);
+    if (end) {
+        commit(out, dst, end);
+    }
+}
+
+/**
+ * Convert and emit a single conversion from an already fetched value.
+ *
+ * @param out output state
+ * @param spec parsed conversion specification
+ * @param width field width, with any '*' already resolved
+ * @param precision precision, with any '.*' already resolved
+ * @param v value fetched for the argClass of spec
+ */
+static void convertValue(zout_t *out, const zspec_t *spec, unsigned width, unsigned precision, const zval_t *v)
+{
+#if ZSNPRINTF_STATS
+    const stats_mark_t mark = statsMark(out);
+    convertSpec(out, spec, width, precision, v);
+    statsRecord(out, spec, &mark);
+#else
+    convertSpec(out, spec, width, precision, v);
+#endif
+}
+
+/**
+ * Run the registered handler for a custom conversion.  It prints straight
+ * into the buffer; streaming to a sink it prints into a temporary of the
+ * chunk's size, so its output is cut at ZSINK_CHUNK_SIZE characters.
+ *
+ * @param out output state
+ * @param spec parsed conversion specification, using a custom specifier
+ * @param width field width, with any '*' already resolved
+ * @param precision precision, with any '.*' already resolved
+ * @param ap argument list for the handler to take its arguments from
+ */
+static void convertCustom(zout_t *out, const zspec_t *spec, unsigned width, unsigned precision, va_list *ap)
+{
+    zspec_t resolved = *spec;
+    resolved.width = width;
+    resolved.precision = precision;
+    const zspec_handler_t handler = customHandler(spec->specifier);
+    if (out->sink) {
+        char tmp[ZSINK_CHUNK_SIZE];
+        const size_t len = handler(tmp, sizeof(tmp), ap, &resolved);
+        emit(out, tmp, len < sizeof(tmp) ? len : sizeof(tmp));
+        return;
+    }
+    const size_t len = handler(out->remain ? out->dest : NULL, out->remain, ap, &resolved);
+    const size_t put = len < out->remain ? len : out->remain;
+    out->dest += put;
+    out->remain -= put;
+    out->len += len;
+}
+
+/**
+ * Apply a '*' width argument.  A negative one reads as the '-' flag and its
+ * magnitude, as in C99, rather than a huge unsigned width.
+ *
+ * @param spec (in/out) conversion; pointed at local if the flag is set
+ * @param local storage for the amended conversion
+ * @param arg width argument
+ * @return field width
+ */
+static inline unsigned starWidth(const zspec_t **spec, zspec_t *local, int arg)
+{
+    if (arg >= 0) {
+        return arg;
+    }
+    *local = **spec;
+    local->flags.leftAlign = 1;
+    *spec = local;
+    return 0u - (unsigned)arg;
+}
+
+/**
+ * Fetch the arguments for a single conversion, then convert and emit them.
+ *
+ * @param out output state
+ * @param spec parsed conversion specification
+ * @param ap argument list to fetch from
+ */
+static void convert(zout_t *out, const zspec_t *spec, va_list *ap)
+{
+    zspec_t local;
+    unsigned width = spec->width;
+    if (spec->width == ZS_ARG_SPECIFIED) { width = starWidth(&spec, &local, va_arg(*ap, int)); }
+    unsigned precision = spec->precision;
+    if (spec->precision == ZS_ARG_SPECIFIED) { precision = va_arg(*ap, int); }
+    if (customHandler(spec->specifier)) {
+        convertCustom(out, spec, width, precision, ap);
+        return;
+    }
+    zval_t val;
+    fetch(argClass(spec), ap, &val);
+    convertValue(out, spec, width, precision, &val);
+}
+
+#if ZSNPRINTF_SIMD
+#define LITERAL_BLOCK 16
+#if defined(__SSE2__)
+#define LITERAL_BITS 1 // mask bits per byte
+#else
+#define LITERAL_BITS 4
+#endif
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__)
+#define LITERAL_BLOCK sizeof(uintptr_t)
+#define LITERAL_BITS 8
+#endif
+
+#ifdef LITERAL_BLOCK
+
+// scanBlock reads past the end of the format string, though never past the
+// aligned block holding its last byte, so never into another page; don't let
+// the address sanitizer report it
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_ASAN __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef NO_ASAN
+#define NO_ASAN
+#endif
+
+/**
+ * Find the '%' and '\0' characters in an aligned block of the format string,
+ * and if there are none, copy the block.
+ *
+ * @param blk block of LITERAL_BLOCK bytes, aligned to its size
+ * @param dst where to copy the block, or NULL not to
+ * @return LITERAL_BITS bits per byte, lowest first in memory order, set
+ *         for each '%' or '\0'
+ */
+static NO_ASAN inline uint64_t scanBlock(const char *blk, char *dst)
+{
+#if ZSNPRINTF_SIMD && defined(__SSE2__)
+    const __m128i v = _mm_load_si128((const __m128i *)blk);
+    const __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')), _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    const uint64_t mask = (unsigned)_mm_movemask_epi8(stop);
+    if (!mask && dst) {
+        _mm_storeu_si128((__m128i *)dst, v);
+    }
+#elif ZSNPRINTF_SIMD
+    const uint8x16_t v = vld1q_u8((const uint8_t *)blk);
+    const uint8x16_t stop = vorrq_u8(vceqq_u8(v, vdupq_n_u8('%')), vceqzq_u8(v));
+    // narrow each byte of the comparison to a nibble
+    const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+    if (!mask && dst) {
+        vst1q_u8((uint8_t *)dst, v);
+    }
+#else
+    // set the high bit of each byte that is 0, or '%' before the xor; exact,
+    // so no false hits after a real one
+    const uintptr_t ones = (uintptr_t)-1 / 0xFF;
+    const uintptr_t low7 = ones * 0x7F;
+    uintptr_t w;
+    __builtin_memcpy(&w, blk, sizeof(w));
+    const uintptr_t pct = w ^ (ones * '%');
+    uintptr_t stop = ~(((w & low7) + low7) | w | low7);
+    stop |= ~(((pct & low7) + low7) | pct | low7);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    stop = __builtin_bswap64((uint64_t)stop) >> (64 - 8 * sizeof(stop)); // memory order
+#endif
+    const uint64_t mask = stop;
+    if (!mask && dst) {
+        __builtin_memcpy(dst, &w, sizeof(w));
+    }
+#endif
+    return mask;
+}
+
+/**
+ * Emit literal text from the format string up to the next conversion or
+ * the end, a block at a time: each block is scanned for '%' and '\0' and
+ * copied from the same load, rather than found with strchr and then copied.
+ *
+ * @param out output state
+ * @param src literal text
+ * @return the '%' or '\0' that ended it
+ */
+static const char *literal(zout_t *out, const char *src)
+{
+    const unsigned skip = (uintptr_t)src % LITERAL_BLOCK;
+    const char *blk = src - skip;
+    uint64_t mask = scanBlock(blk, NULL) >> (skip * LITERAL_BITS);
+    if (!mask) {
+        emit(out, src, LITERAL_BLOCK - skip);
+        // whole blocks while they fit, with the output state updated once
+        char *dst = out->dest;
+        for (size_t blocks = out->remain / LITERAL_BLOCK; blocks; --blocks) {
+            blk += LITERAL_BLOCK;
+            mask = scanBlock(blk, dst);
+            if (mask) {
+                break;
+            }
+            dst += LITERAL_BLOCK;
+        }
+        const size_t copied = (size_t)(dst - out->dest);
+        out->dest = dst;
+        out->remain -= copied;
+        out->len += copied;
+        while (!mask) {
+            blk += LITERAL_BLOCK;
+            mask = scanBlock(blk, NULL);
+            if (!mask) {
+                emit(out, blk, LITERAL_BLOCK);
+            }
+        }
+        src = blk;
+    }
+    const unsigned len = __builtin_ctzll(mask) / LITERAL_BITS;
+    emit(out, src, len);
+    return src + len;
+}
+
+#else
+
+static const char *literal(zout_t *out, const char *src)
+{
+    const char *escape = strchr(src, '%');
+    const size_t len = escape ? (size_t)(escape - src) : strlen(src);
+    emit(out, src, len);
+    return src + len;
+}
+
+#endif /* LITERAL_BLOCK */
+
+/**
+ * Scan a format string, emitting literal spans and conversions as they're
+ * found.
+ *
+ * @param out output state
+ * @param fmt format string
+ * @param ap (in/out) arguments
+ */
+static void format(zout_t *out, const char *fmt, va_list *ap)
+{
+    const char *src = fmt;
+    while (*(src = literal(out, src))) {
+        zspec_t spec;
+        src = scanSpec(src, &spec);
+        if (UNLIKELY(out->stop && !out->remain)) {
+            return;
+        }
+        if (spec.specifier) {
+            convert(out, &spec, ap);
+        }
+    }
+}
+
+size_t zvsnprintf(char *buf, size_t n, const char *fmt, va_list ap)
+{
+    zout_t out = { .dest = buf, .remain = n };
+    va_list args;
+    va_copy(args, ap);
+    format(&out, fmt, &args);
+    va_end(args);
+    return finish(&out, buf, n);
+}
+
+size_t zsnprintf(char *buf, size_t n, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    size_t len = zvsnprintf(buf, n, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+/**
+ * Format like zvsnprintf, but stop as soon as the buffer is full instead of
+ * going on to measure the rest of the output, so the work done is bounded by
+ * n rather than by the arguments.  %s arguments are only scanned as far as
+ * they fit.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param truncated (out) set to whether the output was cut short; may be
+ *        NULL
+ * @param fmt format string
+ * @param ap arguments
+ * @return number of characters written, excluding the terminating '\0'
+ */
+size_t zvsnprintf_trunc(char *buf, size_t n, bool *truncated, const char *fmt, va_list ap)
+{
+    zout_t out = { .dest = buf, .remain = n, .stop = true };
+    va_list args;
+    va_copy(args, ap);
+    format(&out, fmt, &args);
+    va_end(args);
+    const size_t len = finish(&out, buf, n);
+    if (truncated) {
+        *truncated = len >= n && len;
+    }
+    return len < n ? len : n ? n - 1 : 0;
+}
+
+size_t zsnprintf_trunc(char *buf, size_t n, bool *truncated, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    size_t len = zvsnprintf_trunc(buf, n, truncated, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+/**
+ * Parse a format string once into a compact sequence of literal spans and
+ * conversions for repeated use with zvsnprintf_compiled.
+ *
+ * @param fmt format string; must outlive the compiled object
+ * @param out (out) compiled format
+ * @return true on success, false if fmt requires more than ZFMT_MAX_OPS ops
+ */
+bool zformat_compile(const char *fmt, zfmt_t *out)
+{
+    const char *src = fmt;
+    const char *escape;
+    out->nops = 0;
+    while ((escape = strchr(src, '%'))) {
+        if (out->nops >= ZFMT_MAX_OPS) {
+            return false;
+        }
+        zfmt_op_t *op = &out->ops[out->nops];
+        op->lit = src;
+        op->litlen = escape - src;
+        src = scanSpec(escape, &op->spec);
+        if (op->spec.specifier == '%') {
+            // fold the escaped '%' into the literal span
+            op->litlen += 1;
+            op->spec.specifier = '\0';
+        }
+        ++out->nops;
+    }
+    if (*src) {
+        if (out->nops >= ZFMT_MAX_OPS) {
+            return false;
+        }
+        zfmt_op_t *op = &out->ops[out->nops];
+        op->lit = src;
+        op->litlen = strlen(src);
+        op->spec = (zspec_t){ .specifier = '\0' };
+        ++out->nops;
+    }
+    return true;
+}
+
+size_t zvsnprintf_compiled(char *buf, size_t n, const zfmt_t *fmt, va_list ap)
+{
+    zout_t out = { .dest = buf, .remain = n };
+    va_list args;
+    va_copy(args, ap);
+    for (unsigned i = 0; i < fmt->nops; ++i) {
+        const zfmt_op_t *op = &fmt->ops[i];
+        emit(&out, op->lit, op->litlen);
+        if (op->spec.specifier) {
+            convert(&out, &op->spec, &args);
+        }
+    }
+    va_end(args);
+    return finish(&out, buf, n);
+}
+
+size_t zsnprintf_compiled(char *buf, size_t n, const zfmt_t *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    size_t len = zvsnprintf_compiled(buf, n, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+/**
+ * Format to a sink, streaming output through its write callback a chunk at a
+ * time.  Memory use is bounded by the sink's chunk regardless of the length
+ * of the output.  Everything is handed to the callback before returning, and
+ * no terminating '\0' is written.
+ *
+ * @param sink sink with write and ctx set
+ * @param fmt format string
+ * @param ap arguments
+ * @return number of characters written
+ */
+size_t zvcbprintf(zsink_t *sink, const char *fmt, va_list ap)
+{
+    zout_t out = { .dest = sink->chunk, .remain = sizeof(sink->chunk), .sink = sink };
+    va_list args;
+    va_copy(args, ap);
+    format(&out, fmt, &args);
+    va_end(args);
+    drain(&out);
+#if ZSNPRINTF_STATS
+    statsCall(false);
+#endif
+    return out.len;
+}
+
+size_t zcbprintf(zsink_t *sink, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    size_t len = zvcbprintf(sink, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+/**
+ * Convert and emit a float argument at its own width, for zsnprintf_args.
+ * The basic backend converts it with zftoaf, as on 32-bit double targets,
+ * so no double arithmetic is involved; the shortest backend widens it.
+ *
+ * @param out output state
+ * @param spec floating point conversion specification
+ * @param width field width, with any '*' already resolved
+ * @param precision precision, with any '.*' already resolved
+ * @param f value
+ */
+static void convertFloat(zout_t *out, const zspec_t *spec, unsigned width, unsigned precision, float f)
+{
+#if ZSNPRINTF_FLOAT_BACKEND == ZSNPRINTF_FLOAT_SHORTEST
+    const zval_t val = { .d = f };
+    zspec_t dspec = *spec;
+    dspec.length = zs_length_int;
+    convertValue(out, &dspec, width, precision, &val);
+#else
+#if ZSNPRINTF_STATS
+    const stats_mark_t mark = statsMark(out);
+#endif
+    char tmp[CONVERT_BUF_SIZE];
+    char *dst = reserve(out, tmp);
+    zs_flags_t flags = spec->flags;
+    const char specifier = spec->specifier;
+    if (specifier == 'e' || specifier == 'a') {
+        flags.exp = zs_exp_e;
+    } else if (specifier == 'E' || specifier == 'A') {
+        flags.exp = zs_exp_E;
+    } else if (specifier == 'g' || specifier == 'G') {
+        float absv = fabsf(f);
+        if (absv < GMINF || absv > GMAXF) {
+            flags.exp = specifier == 'g' ? zs_exp_e : zs_exp_E;
+        }
+    }
+    char *end = zftoaf(dst, f, width, precision == (unsigned)ZS_PRECISION_UNSPECIFIED ? DEFAULT_PRECISION : precision, flags);
+    commit(out, dst, end);
+#if ZSNPRINTF_STATS
+    statsRecord(out, spec, &mark);
+#endif
+#endif
+}
+
+/**
+ * @param arg tagged argument
+ * @return the argument as a signed integer, or 0 if it isn't an integer
+ */
+static inline int64_t argInteger(const zarg_t *arg)
+{
+    switch (arg->type) {
+        case zarg_int: return arg->v.i;
+        case zarg_long: return arg->v.l;
+        case zarg_long_long: return arg->v.ll;
+        default: return 0;
+    }
+}
+
+/**
+ * Take the arguments for a single conversion from a tagged argument array,
+ * then convert and emit them.  An argument whose tag doesn't suit the
+ * conversion, or a missing one, leaves the conversion out of the output.
+ *
+ * @param out output state
+ * @param spec parsed conversion specification
+ * @param next (in/out) next argument to take
+ * @param end end of the argument array
+ * @return false for a custom specifier, whose handler takes its arguments
+ *         from a va_list, so how many it would take isn't known
+ */
+static bool convertArg(zout_t *out, const zspec_t *spec, const zarg_t **next, const zarg_t *end)
+{
+    if (customHandler(spec->specifier)) {
+        return false;
+    }
+    zspec_t local;
+    unsigned width = spec->width;
+    if (spec->width == ZS_ARG_SPECIFIED) { width = *next < end ? starWidth(&spec, &local, (int)argInteger((*next)++)) : 0; }
+    unsigned precision = spec->precision;
+    if (spec->precision == ZS_ARG_SPECIFIED) { precision = *next < end ? argInteger((*next)++) : ZS_PRECISION_UNSPECIFIED; }
+    const arg_class_t cls = argClass(spec);
+    zval_t val = { 0 };
+    if (cls == arg_none) {
+        convertValue(out, spec, width, precision, &val); // '%'
+        return true;
+    }
+    if (*next == end) {
+        return true;
+    }
+    const zarg_t *arg = (*next)++;
+    const zarg_type_t type = arg->type;
+    if (cls == arg_int || cls == arg_long || cls == arg_long_long) {
+        if (type != zarg_int && type != zarg_long && type != zarg_long_long) {
+            return true;
+        }
+        const int64_t x = argInteger(arg);
+        intValue(spec, x, x, &val);
+    } else if (cls == arg_double || cls == arg_long_double) {
+        if (type == zarg_float) {
+            convertFloat(out, spec, width, precision, arg->v.f);
+            return true;
+        } else if (type != zarg_double && type != zarg_long_double) {
+            return true;
+        }
+        const long double x = type == zarg_double ? arg->v.d : arg->v.ld;
+        if (cls == arg_long_double) {
+            val.ld = x;
+        } else {
+            val.d = x;
+        }
+    } else if (cls == arg_ptr) {
+        if (type != zarg_ptr) {
+            return true;
+        }
+        val.p = (void *)arg->v.p;
+    } else {
+        if (type != zarg_str) {
+            return true;
+        }
+        val.s = arg->v.s;
+    }
+    convertValue(out, spec, width, precision, &val);
+    return true;
+}
+
+/**
+ * Format from a tagged argument array instead of a va_list, e.g. in an ISR
+ * or from code that builds arguments at run time.  Nothing is promoted:
+ * integers are extended only as far as their conversion's length, and
+ * float arguments are converted as floats.  Each conversion, '*' width and
+ * '.*' precision takes the next argument in turn.  Specifiers added with
+ * zspec_register aren't supported, as their handlers read a va_list.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param fmt format string
+ * @param args arguments, e.g. { ZARG_INT(id), ZARG_FLOAT(volts) }
+ * @param nargs number of arguments
+ * @return number of characters in the full output, as for zvsnprintf, or 0
+ *         with nothing printed if fmt uses a custom specifier
+ */
+size_t zsnprintf_args(char *buf, size_t n, const char *fmt, const zarg_t *args, size_t nargs)
+{
+    zout_t out = { .dest = buf, .remain = n };
+    const zarg_t *next = args;
+    const zarg_t *end = args + nargs;
+    const char *src = fmt;
+    const char *escape;
+    while ((escape = strchr(src, '%'))) {
+        emit(&out, src, escape - src);
+        zspec_t spec;
+        src = scanSpec(escape, &spec);
+        if (spec.specifier && !convertArg(&out, &spec, &next, end)) {
+            out = (zout_t){ .dest = buf, .remain = n };
+            finish(&out, buf, n);
+            return 0;
+        }
+    }
+    emit(&out, src, strlen(src));
+    return finish(&out, buf, n);
+}
+
+#ifdef __GNUC__
+#define PREFETCH(_addr) __builtin_prefetch(_addr)
+#else
+#define PREFETCH(_addr)
+#endif
+
+/**
+ * Count the arguments a record of a compiled format takes.
+ *
+ * @param fmt compiled format
+ * @param nargs (out) number of arguments
+ * @return false if fmt uses a custom specifier, whose arguments convertArg
+ *         can't take
+ */
+static bool compiledArgs(const zfmt_t *fmt, size_t *nargs)
+{
+    *nargs = 0;
+    for (unsigned i = 0; i < fmt->nops; ++i) {
+        const zspec_t *spec = &fmt->ops[i].spec;
+        if (customHandler(spec->specifier)) {
+            return false;
+        }
+        if (spec->specifier) {
+            *nargs += 1 + (spec->width == ZS_ARG_SPECIFIED) + (spec->precision == ZS_ARG_SPECIFIED);
+        }
+    }
+    return true;
+}
+
+/**
+ * Format a burst of records sharing one compiled format back to back into a
+ * single output region, e.g. to hand to writev.  The format is parsed once
+ * for all of them, and the one loop over the records keeps the converters
+ * hot; strings of the next record are prefetched while the current one is
+ * formatted.  Records are not split: formatting stops at the first one that
+ * doesn't fit in full, leaving it for the next batch.  %n stores the
+ * offset within the record.  As for zsnprintf_args, specifiers added with
+ * zspec_register aren't supported.
+ *
+ * @param fmt compiled format
+ * @param args arguments, record after record, each with as many as fmt
+ *        takes, in the order zsnprintf_args would
+ * @param nrec number of records
+ * @param out output region; terminated with a '\0' after the last record
+ * @param outsz size of out
+ * @param offsets (out) start of each formatted record in out, followed by
+ *        the end of the last one, so record i is out[offsets[i]] up to
+ *        out[offsets[i + 1]]; room for nrec + 1 entries; may be NULL
+ * @return number of records formatted; 0 if fmt uses a custom specifier
+ */
+size_t zsnprintf_batch(const zfmt_t *fmt, const zarg_t *args, size_t nrec, char *out, size_t outsz, size_t *offsets)
+{
+    size_t nargs;
+    if (!compiledArgs(fmt, &nargs)) {
+        nrec = 0;
+    }
+    zout_t o = { .dest = out, .remain = outsz, .stop = true };
+    size_t i;
+    for (i = 0; i < nrec; ++i) {
+        const zarg_t *rec = args + i * nargs;
+        const zarg_t *end = rec + nargs;
+        if (i + 1 < nrec) {
+            for (const zarg_t *a = end; a < end + nargs; ++a) {
+                if (a->type == zarg_str) {
+                    PREFETCH(a->v.s);
+                }
+            }
+        }
+        if (offsets) {
+            offsets[i] = o.len;
+        }
+        // each record counts from its own start, so %n stores the offset
+        // within the record
+        zout_t r = { .dest = o.dest, .remain = o.remain, .stop = true };
+        const zarg_t *next = rec;
+        for (unsigned k = 0; k < fmt->nops && r.remain; ++k) {
+            const zfmt_op_t *op = &fmt->ops[k];
+            emit(&r, op->lit, op->litlen);
+            if (op->spec.specifier && r.remain) {
+                convertArg(&r, &op->spec, &next, end);
+            }
+        }
+        if (r.len >= o.remain) {
+            // no room for all of it and the '\0'; leave it out
+            break;
+        }
+        o.dest = r.dest;
+        o.remain = r.remain;
+        o.len += r.len;
+    }
+    if (offsets) {
+        offsets[i] = o.len;
+    }
+    finish(&o, out, outsz);
+    return i;
+}
+
+/**
+ * @param cls argument type, from argClass
+ * @return number of bytes a value of that type takes in a captured record
+ */
+static size_t valueSize(arg_class_t cls)
+{
+    switch (cls) {
+        case arg_int: return sizeof(unsigned);
+        case arg_long: return sizeof(long unsigned);
+        case arg_long_long: return sizeof(long long unsigned);
+        case arg_double: return sizeof(double);
+        case arg_long_double: return sizeof(long double);
+        case arg_ptr: return sizeof(void *);
+        case arg_str: return sizeof(const char *);
+        default: return 0;
+    }
+}
+
+/**
+ * @param spec parsed conversion specification
+ * @param precision precision, with any '.*' already resolved
+ * @return number of bytes an address conversion reads, or 0 for other
+ *         conversions
+ */
+static size_t addrBytes(const zspec_t *spec, int precision)
+{
+    switch (spec->specifier) {
+        case '4': return 4;
+        case '6': case 'U': return 16;
+        case 'M': return precision < 0 ? MAC_DEFAULT_BYTES : precision;
+        default: return 0;
+    }
+}
+
+/**
+ * Append to a captured record, counting bytes that don't fit.
+ *
+ * @param rec record
+ * @param n capacity of rec
+ * @param pos (in/out) size of the record so far
+ * @param src bytes to append
+ * @param len number of bytes to append
+ */
+static inline void pack(char *rec, size_t n, size_t *pos, const void *src, size_t len)
+{
+    if (len <= n && *pos <= n - len) {
+        ZCOAP_MEMCPY(rec + *pos, src, len);
+    }
+    *pos += len;
+}
+
+/**
+ * Read the next field of a captured record.
+ *
+ * @param rec (in/out) read position; advanced past the field
+ * @param dst (out) field
+ * @param len size of the field
+ */
+static inline void unpack(const char **rec, void *dst, size_t len)
+{
+    ZCOAP_MEMCPY(dst, *rec, len);
+    *rec += len;
+}
+
+/**
+ * Run the registered handler for a custom conversion while capturing, and
+ * append its output to the record as a string.
+ *
+ * @param rec record
+ * @param n capacity of rec
+ * @param pos size of the record so far
+ * @param spec parsed conversion specification, using a custom specifier
+ * @param width field width, with any '*' already resolved
+ * @param precision precision, with any '.*' already resolved
+ * @param ap argument list for the handler to take its arguments from
+ * @return new size of the record
+ */
+static size_t captureCustom(char *rec, size_t n, size_t pos, const zspec_t *spec, unsigned width, int precision, va_list *ap)
+{
+    zspec_t resolved = *spec;
+    resolved.width = width;
+    resolved.precision = precision;
+    const size_t room = pos < n ? n - pos : 0;
+    const size_t len = customHandler(spec->specifier)(room ? rec + pos : NULL, room ? room - 1 : 0, ap, &resolved);
+    if (len < room) {
+        rec[pos + len] = '\0';
+    }
+    return pos + len + 1;
+}
+
+/**
+ * Capture a formatting request for zrender to convert later.  Only the format
+ * pointer and the raw arguments are stored; strings passed for %s, and the
+ * bytes of addresses passed for %pI4, %pI6, %pM and %pU, are copied, while the
+ * format string itself, and any %n pointer, must remain valid until the
+ * record is rendered.
+ *
+ * @param rec buffer for the record; needs no particular alignment
+ * @param n size of rec
+ * @param fmt format string
+ * @param ap arguments
+ * @return size of the record; if larger than n, rec is incomplete and must
+ *         not be rendered
+ */
+size_t zvcapture(void *rec, size_t n, const char *fmt, va_list ap)
+{
+    size_t pos = 0;
+    const char *src = fmt;
+    const char *escape;
+    va_list args;
+    va_copy(args, ap);
+    pack(rec, n, &pos, &fmt, sizeof(fmt));
+    while ((escape = strchr(src, '%'))) {
+        zspec_t spec;
+        src = scanSpec(escape, &spec);
+        if (!spec.specifier) {
+            continue;
+        }
+        const zspec_t *conv = &spec;
+        zspec_t local;
+        unsigned width = spec.width;
+        if (spec.width == ZS_ARG_SPECIFIED) {
+            const int arg = va_arg(args, int);
+            pack(rec, n, &pos, &arg, sizeof(arg));
+            width = starWidth(&conv, &local, arg);
+        }
+        int precision = spec.precision;
+        if (spec.precision == ZS_ARG_SPECIFIED) {
+            precision = va_arg(args, int);
+            pack(rec, n, &pos, &precision, sizeof(precision));
+        }
+        if (customHandler(spec.specifier)) {
+            pos = captureCustom(rec, n, pos, conv, width, precision, &args);
+            continue;
+        }
+        const arg_class_t cls = argClass(&spec);
+        zval_t val = { 0 };
+        fetch(cls, &args, &val);
+        const size_t nbytes = addrBytes(&spec, precision);
+        if (cls == arg_str) {
+            // only as much as prints, as a precision may end the string
+            // before any '\0'; the copy is terminated for zrender
+            const zout_t unbounded = { 0 };
+            pack(rec, n, &pos, val.s, strLength(&unbounded, val.s, width, precision));
+            pack(rec, n, &pos, "", 1);
+        } else if (nbytes) {
+            pack(rec, n, &pos, val.p, nbytes);
+        } else {
+            pack(rec, n, &pos, &val, valueSize(cls));
+        }
+    }
+    va_end(args);
+    return pos;
+}
+
+size_t zcapture(void *rec, size_t n, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    size_t len = zvcapture(rec, n, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+/**
+ * Format a record stored by zvcapture, exactly as zvsnprintf would have
+ * formatted the original call.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param rec complete record from zvcapture
+ * @return number of characters in the full output, as for zvsnprintf
+ */
+size_t zrender(char *buf, size_t n, const void *rec)
+{
+    zout_t out = { .dest = buf, .remain = n };
+    const char *p = rec;
+    const char *fmt;
+    unpack(&p, &fmt, sizeof(fmt));
+    const char *src = fmt;
+    const char *escape;
+    while ((escape = strchr(src, '%'))) {
+        emit(&out, src, escape - src);
+        zspec_t spec;
+        src = scanSpec(escape, &spec);
+        if (!spec.specifier) {
+            continue;
+        }
+        const zspec_t *conv = &spec;
+        zspec_t local;
+        unsigned width = spec.width;
+        if (spec.width == ZS_ARG_SPECIFIED) {
+            int arg;
+            unpack(&p, &arg, sizeof(arg));
+            width = starWidth(&conv, &local, arg);
+        }
+        int precision = spec.precision;
+        if (spec.precision == ZS_ARG_SPECIFIED) { unpack(&p, &precision, sizeof(precision)); }
+        if (customHandler(spec.specifier)) {
+            // custom; the handler's output was stored at capture time
+            const size_t len = strlen(p);
+            emit(&out, p, len);
+            p += len + 1;
+            continue;
+        }
+        const arg_class_t cls = argClass(&spec);
+        const size_t nbytes = addrBytes(&spec, precision);
+        zval_t val;
+        if (cls == arg_str) {
+            val.s = p;
+            p += strlen(p) + 1;
+        } else if (nbytes) {
+            val.p = (void *)p;
+            p += nbytes;
+        } else {
+            unpack(&p, &val, valueSize(cls));
+        }
+        convertValue(&out, conv, width, precision, &val);
+    }
+    emit(&out, src, strlen(src));
+    return finish(&out, buf, n);
+}
+
+/**
+ * Parse a single conversion specification, e.g. "%08x", for the array
+ * formatters.
+ *
+ * @param conv conversion specification, starting with '%'
+ * @param spec (out) parsed specification
+ * @return true if conv is exactly one valid conversion
+ */
+bool zspec_parse(const char *conv, zspec_t *spec)
+{
+    if (*conv != '%') {
+        return false;
+    }
+    const char *end = scanSpec(conv, spec);
+    return spec->specifier && !customHandler(spec->specifier) && spec->specifier != '%' && spec->specifier != 'n' && !*end;
+}
+
+/**
+ * Resolve the width and precision of a spec used without a va_list, where
+ * '*' has no argument to read and counts as unspecified.
+ *
+ * @param spec parsed conversion specification
+ * @param width (out) field width
+ * @param precision (out) precision
+ */
+static inline void fixedFields(const zspec_t *spec, unsigned *width, unsigned *precision)
+{
+    *width = spec->width == ZS_ARG_SPECIFIED ? 0 : spec->width;
+    *precision = spec->precision == ZS_ARG_SPECIFIED ? (unsigned)ZS_PRECISION_UNSPECIFIED : (unsigned)spec->precision;
+}
+
+/**
+ * State shared by the array formatters.
+ */
+typedef struct zarray_s {
+    zout_t out;
+    zspec_t spec;
+    unsigned width;
+    unsigned precision;
+    const char *sep;
+    size_t seplen;
+} zarray_t;
+
+/**
+ * Prepare to format an array of one argument class, checking that the spec
+ * converts that class.
+ *
+ * @param a (out) array state
+ * @param buf output buffer
+ * @param n size of buf
+ * @param spec conversion for each element
+ * @param sep separator between elements, or NULL for none
+ * @param floating true for float arrays, false for integer arrays
+ * @return true if spec suits the array
+ */
+static bool arrayStart(zarray_t *a, char *buf, size_t n, const zspec_t *spec, const char *sep, bool floating)
+{
+    a->out = (zout_t){ .dest = buf, .remain = n };
+    a->spec = *spec;
+    fixedFields(spec, &a->width, &a->precision);
+    a->sep = sep ? sep : "";
+    a->seplen = strlen(a->sep);
+    const arg_class_t cls = argClass(spec);
+    const bool ok =   floating
+                    ? cls == arg_double || cls == arg_long_double
+                    : cls == arg_int || cls == arg_long || cls == arg_long_long;
+    if (!ok) {
+        finish(&a->out, buf, n);
+    }
+    return ok;
+}
+
+/**
+ * Emit one element, preceded by the separator unless it's the first.
+ */
+static inline void arrayElement(zarray_t *a, size_t i, const zval_t *val)
+{
+    if (i) {
+        emit(&a->out, a->sep, a->seplen);
+    }
+    convertValue(&a->out, &a->spec, a->width, a->precision, val);
+}
+
+/**
+ * Format an array of int32_t with one parsed conversion, e.g. as CSV.  The
+ * format isn't re-parsed per element and no va_list is involved.  '*' width
+ * and precision aren't supported and read as unspecified.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param v elements
+ * @param count number of elements
+ * @param spec integer conversion from zspec_parse; the length is implied by
+ *        the element type
+ * @param sep separator printed between elements, or NULL for none
+ * @return number of characters in the full output, as for zvsnprintf, or 0
+ *         if spec isn't an integer conversion
+ */
+size_t zformat_i32_array(char *buf, size_t n, const int32_t *v, size_t count, const zspec_t *spec, const char *sep)
+{
+    zarray_t a;
+    if (!arrayStart(&a, buf, n, spec, sep, false)) {
+        return 0;
+    }
+    a.spec.length = LENGTH_INT32_T;
+    for (size_t i = 0; i < count; ++i) {
+        zval_t val;
+        intValue(&a.spec, v[i], (uint32_t)v[i], &val);
+        arrayElement(&a, i, &val);
+    }
+    return finish(&a.out, buf, n);
+}
+
+/**
+ * As zformat_i32_array, for uint64_t elements.
+ */
+size_t zformat_u64_array(char *buf, size_t n, const uint64_t *v, size_t count, const zspec_t *spec, const char *sep)
+{
+    zarray_t a;
+    if (!arrayStart(&a, buf, n, spec, sep, false)) {
+        return 0;
+    }
+    a.spec.length = zs_length_long_long;
+    for (size_t i = 0; i < count; ++i) {
+        zval_t val;
+        intValue(&a.spec, (int64_t)v[i], v[i], &val);
+        arrayElement(&a, i, &val);
+    }
+    return finish(&a.out, buf, n);
+}
+
+/**
+ * As zformat_i32_array, for float elements, which are printed as doubles.
+ *
+ * @return number of characters in the full output, or 0 if spec isn't a
+ *         floating point conversion
+ */
+size_t zformat_f32_array(char *buf, size_t n, const float *v, size_t count, const zspec_t *spec, const char *sep)
+{
+    zarray_t a;
+    if (!arrayStart(&a, buf, n, spec, sep, true)) {
+        return 0;
+    }
+    a.spec.length = zs_length_int;
+    for (size_t i = 0; i < count; ++i) {
+        const zval_t val = { .d = v[i] };
+        arrayElement(&a, i, &val);
+    }
+    return finish(&a.out, buf, n);
+}
+
+/**
+ * As zformat_f32_array, for double elements.
+ */
+size_t zformat_f64_array(char *buf, size_t n, const double *v, size_t count, const zspec_t *spec, const char *sep)
+{
+    zarray_t a;
+    if (!arrayStart(&a, buf, n, spec, sep, true)) {
+        return 0;
+    }
+    a.spec.length = zs_length_int;
+    for (size_t i = 0; i < count; ++i) {
+        const zval_t val = { .d = v[i] };
+        arrayElement(&a, i, &val);
+    }
+    return finish(&a.out, buf, n);
+}
+
+/**
+ * Prepare a %f conversion for zformat_fspec and zformat_fspec_array, which
+ * print values below 2^64 in magnitude with 64-bit integer arithmetic rather
+ * than through the float backend: the whole part and the rounded fraction
+ * are each converted with one zu64toa.  Precision goes up to
+ * ZFSPEC_MAX_PRECISION, and the output is rounded from the exact binary
+ * value, half to even, as glibc's printf does.  Other values print as for
+ * zformat_double, and a '*' width or precision reads as unspecified, as it
+ * does there.
+ *
+ * @param spec %f or %F conversion, e.g. from zspec_parse; precision beyond
+ *        ZFSPEC_MAX_PRECISION is cut to it
+ * @param fs (out) the prepared conversion
+ * @return true if spec is a %f or %F conversion
+ */
+bool zfspec_prepare(const zspec_t *spec, zfspec_t *fs)
+{
+    if (spec->specifier != 'f' && spec->specifier != 'F') {
+        return false;
+    }
+    unsigned width, precision;
+    fixedFields(spec, &width, &precision);
+    if (precision == (unsigned)ZS_PRECISION_UNSPECIFIED) {
+        precision = DEFAULT_PRECISION;
+    } else if (precision > ZFSPEC_MAX_PRECISION) {
+        precision = ZFSPEC_MAX_PRECISION;
+    }
+    fs->spec = *spec;
+    fs->spec.length = zs_length_int; // values are passed as doubles
+    fs->spec.width = width;
+    fs->spec.precision = precision;
+    fs->limit = 1;
+    for (unsigned i = 0; i < precision; ++i) {
+        fs->limit *= 10;
+    }
+    fs->scale = fs->limit;
+    const double c = 134217729.0 * fs->scale; // 2^27 + 1
+    fs->scale_hi = c - (c - fs->scale);
+    fs->scale_lo = fs->scale - fs->scale_hi;
+    return true;
+}
+
+/**
+ * The rounding error of fraction * fs->scale, so their product is exactly
+ * the sum of the rounded product and the error.
+ *
+ * @param fraction value in [0, 1)
+ * @param fs prepared conversion
+ * @param product fraction * fs->scale, rounded
+ * @return the exact product less product
+ */
+static inline double productError(double fraction, const zfspec_t *fs, double product)
+{
+#ifdef FP_FAST_FMA
+    return fma(fraction, fs->scale, -product);
+#else
+    // Dekker's product; without fast fma the compiler can't contract it
+    const double c = 134217729.0 * fraction; // 2^27 + 1
+    const double hi = c - (c - fraction);
+    const double lo = fraction - hi;
+    return ((hi * fs->scale_hi - product) + hi * fs->scale_lo + lo * fs->scale_hi) + lo * fs->scale_lo;
+#endif
+}
+
+/**
+ * Print a finite value below 2^64 in magnitude as a prepared %f.  The
+ * fraction is split off exactly and scaled with a single multiply, whose
+ * rounding error decides any close call in rounding to the precision.
+ *
+ * @param buf buffer of sizeof(MAX_FIXED_FMT)
+ * @param fs prepared conversion
+ * @param v value to print
+ * @return pointer to next character in the printed buffer
+ */
+static char *fixedToa(char *buf, const zfspec_t *fs, double v)
+{
+    const zs_flags_t none = { 0 };
+    const zs_flags_t flags = fs->spec.flags;
+    const unsigned precision = fs->spec.precision;
+    const double mag = fabs(v);
+    uint64_t whole = mag;
+    const double scaled = (mag - whole) * fs->scale;
+    const double error = productError(mag - whole, fs, scaled);
+    uint64_t fraction = scaled;
+    const double rest = scaled - fraction; // exact; 0 once scaled reaches 2^52
+    if (rest) {
+        // the error is at most half an ulp of scaled, so can't carry rest
+        // across one half, only break a tie
+        fraction += rest > 0.5 || (rest == 0.5 && (error > 0 || (error == 0 && ((precision ? fraction : whole) & 1))));
+    } else if (error) {
+        // scaled is a whole number, and past 2^53 the error can be several
+        const double below = floor(error);
+        const double half = error - below;
+        fraction += (int64_t)below;
+        fraction += half > 0.5 || (half == 0.5 && ((precision ? fraction : whole) & 1));
+    }
+    if (fraction >= fs->limit) {
+        fraction -= fs->limit;
+        ++whole;
+    }
+    char sign = '\0';
+    if (signbit(v)) {
+        sign = '-';
+    } else if (flags.sign == zs_always_sign) {
+        sign = '+';
+    } else if (flags.sign == zs_sign_or_space) {
+        sign = ' ';
+    }
+    unsigned width = fs->spec.width;
+    if (width > sizeof(MAX_FIXED_FMT) - 1) {
+        width = sizeof(MAX_FIXED_FMT) - 1;
+    }
+    if (width) {
+        // the padding depends on the length of the whole part
+        char digits[sizeof(MAX_FIXED_FMT)];
+        const unsigned wlen = zu64toa(digits, whole, 0, none) - digits;
+        const unsigned len = (sign != '\0') + wlen + (precision || flags.altForm) + precision;
+        const unsigned pad = width > len ? width - len : 0;
+        if (!flags.zeropad) {
+            memset(buf, ' ', pad);
+            buf += pad;
+        }
+        if (sign) {
+            *buf = sign;
+            ++buf;
+        }
+        if (flags.zeropad) {
+            memset(buf, '0', pad);
+            buf += pad;
+        }
+        memcpy(buf, digits, wlen);
+        buf += wlen;
+    } else {
+        if (sign) {
+            *buf = sign;
+            ++buf;
+        }
+        buf = zu64toa(buf, whole, 0, none);
+    }
+    if (precision) {
+        // 10^precision + fraction has the fraction's digits, zero-padded,
+        // after a leading 1 that becomes the '.'
+        char *const point = buf;
+        buf = zu64toa(buf, fs->limit + fraction, 0, none);
+        *point = '.';
+    } else if (flags.altForm) {
+        *buf = '.';
+        ++buf;
+    }
+    return buf;
+}
+
+/**
+ * Convert one value with a prepared %f, falling back to the float backend
+ * for values fixedToa doesn't cover.
+ */
+static void fixedValue(zout_t *out, const zfspec_t *fs, double v)
+{
+    if (!(fabs(v) < 18446744073709551616.0)) { // 2^64, or not finite
+        const zval_t val = { .d = v };
+        convertValue(out, &fs->spec, fs->spec.width, fs->spec.precision, &val);
+        return;
+    }
+#if ZSNPRINTF_STATS
+    const stats_mark_t mark = statsMark(out);
+#endif
+    char tmp[sizeof(MAX_FIXED_FMT)];
+    char *const tok = out->remain >= sizeof(tmp) ? out->dest : tmp;
+    commit(out, tok, fixedToa(tok, fs, v));
+#if ZSNPRINTF_STATS
+    statsRecord(out, &fs->spec, &mark);
+#endif
+}
+
+/**
+ * Format a double with a conversion prepared by zfspec_prepare.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param fs prepared conversion
+ * @param v value
+ * @return number of characters in the full output, as for zvsnprintf
+ */
+size_t zformat_fspec(char *buf, size_t n, const zfspec_t *fs, double v)
+{
+    zout_t out = { .dest = buf, .remain = n };
+    fixedValue(&out, fs, v);
+    return finish(&out, buf, n);
+}
+
+/**
+ * As zformat_f64_array, with a conversion prepared by zfspec_prepare, for
+ * columns of values printed to the same precision.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param v elements
+ * @param count number of elements
+ * @param fs prepared conversion
+ * @param sep separator printed between elements, or NULL for none
+ * @return number of characters in the full output, as for zvsnprintf
+ */
+size_t zformat_fspec_array(char *buf, size_t n, const double *v, size_t count, const zfspec_t *fs, const char *sep)
+{
+    zout_t out = { .dest = buf, .remain = n };
+    sep = sep ? sep : "";
+    const size_t seplen = strlen(sep);
+    for (size_t i = 0; i < count; ++i) {
+        if (i) {
+            emit(&out, sep, seplen);
+        }
+        fixedValue(&out, fs, v[i]);
+    }
+    return finish(&out, buf, n);
+}
+
+/**
+ * Convert one value for the single-value formatters.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param spec conversion
+ * @param ok true if spec converts the value's argument class
+ * @param val value, stored in the member argClass(spec) reads
+ * @return number of characters in the full output, or 0 if !ok
+ */
+static size_t formatValue(char *buf, size_t n, const zspec_t *spec, bool ok, const zval_t *val)
+{
+    zout_t out = { .dest = buf, .remain = n };
+    if (!ok) {
+        finish(&out, buf, n);
+        return 0;
+    }
+    unsigned width, precision;
+    fixedFields(spec, &width, &precision);
+    convertValue(&out, spec, width, precision, val);
+    return finish(&out, buf, n);
+}
+
+/**
+ * Format a single integer with a parsed conversion, for callers holding
+ * typed values rather than a va_list, such as the C++ front end in
+ * zsnprintf.hpp.  Outputs of successive calls can be concatenated by passing
+ * the unused tail of the buffer.  '*' width and precision read as
+ * unspecified; store the values in a copy of the spec instead.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param spec integer or %c conversion, e.g. from zspec_parse
+ * @param v value, sign- or zero-extended from its type as printf's argument
+ *        promotion would; the spec's length selects the bits printed
+ * @return number of characters in the full output, as for zvsnprintf, or 0
+ *         if spec doesn't convert an integer
+ */
+size_t zformat_int(char *buf, size_t n, const zspec_t *spec, long long unsigned v)
+{
+    const arg_class_t cls = argClass(spec);
+    zval_t val;
+    if (spec->specifier == 'c') {
+        val.u = v;
+    } else {
+        intValue(spec, (int64_t)v, v, &val);
+    }
+    return formatValue(buf, n, spec, cls == arg_int || cls == arg_long || cls == arg_long_long, &val);
+}
+
+/**
+ * As zformat_int, for a floating point conversion.
+ */
+size_t zformat_double(char *buf, size_t n, const zspec_t *spec, double v)
+{
+    const arg_class_t cls = argClass(spec);
+    zval_t val;
+    if (cls == arg_long_double) {
+        val.ld = v;
+    } else {
+        val.d = v;
+    }
+    return formatValue(buf, n, spec, cls == arg_double || cls == arg_long_double, &val);
+}
+
+/**
+ * As zformat_double, for a long double.
+ */
+size_t zformat_long_double(char *buf, size_t n, const zspec_t *spec, long double v)
+{
+    const arg_class_t cls = argClass(spec);
+    zval_t val;
+    if (cls == arg_long_double) {
+        val.ld = v;
+    } else {
+        val.d = v;
+    }
+    return formatValue(buf, n, spec, cls == arg_double || cls == arg_long_double, &val);
+}
+
+/**
+ * As zformat_int, for a %s conversion.
+ */
+size_t zformat_str(char *buf, size_t n, const zspec_t *spec, const char *s)
+{
+    const zval_t val = { .s = s };
+    return formatValue(buf, n, spec, argClass(spec) == arg_str, &val);
+}
+
+/**
+ * As zformat_int, for a %p conversion, or an address conversion given a
+ * pointer to the address bytes.
+ */
+size_t zformat_ptr(char *buf, size_t n, const zspec_t *spec, const void *p)
+{
+    const zval_t val = { .p = (void *)p };
+    return formatValue(buf, n, spec, argClass(spec) == arg_ptr && spec->specifier != 'n', &val);
+}
+
+/**
+ * Print a buffer as hex, two digits per byte in memory order, e.g. for
+ * packet payloads.  Eight bytes are expanded at a time.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param data bytes to print
+ * @param len number of bytes
+ * @param upper true for uppercase digits
+ * @return number of characters in the full output, i.e. 2 * len, as for
+ *         zvsnprintf
+ */
+size_t zhexdump(char *buf, size_t n, const void *data, size_t len, bool upper)
+{
+    zout_t out = { .dest = buf, .remain = n };
+    const uint8_t *src = data;
+    char chunk[16];
+    for (; len >= 8 && out.remain; len -= 8, src += 8) {
+        if (out.remain >= sizeof(chunk)) {
+            zhex8(out.dest, src, upper);
+            commit(&out, out.dest, out.dest + sizeof(chunk));
+        } else {
+            zhex8(chunk, src, upper);
+            emit(&out, chunk, sizeof(chunk));
+        }
+    }
+    for (; len && out.remain; --len, ++src) {
+        chunk[0] = hex_digits[upper][*src >> 4];
+        chunk[1] = hex_digits[upper][*src & 0xF];
+        emit(&out, chunk, 2);
+    }
+    out.len += 2 * len; // measure what didn't fit
+    return finish(&out, buf, n);
+}
+
+#define FIXED_MAX_DIGITS 9 // fraction digits; 10^9 is the largest power in 32 bits
+
+static const uint32_t pow10_u32[FIXED_MAX_DIGITS + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+#define FRAC_MAX_DIGITS 10 // digits of a uint32_t fraction; any more are leading zeros
+
+/**
+ * Emit a fixed-point number from its parts, with the field width, sign and
+ * padding flags of %f.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param neg true if the value is negative
+ * @param whole integer part of the magnitude
+ * @param frac fraction digits of the magnitude, as an integer
+ * @param digits number of fraction digits; those past FRAC_MAX_DIGITS
+ *        are leading zeros
+ * @param width field width, or 0
+ * @param flags ZFIX_* flags
+ * @return number of characters in the full output, as for zvsnprintf
+ */
+static size_t fixedOut(char *buf, size_t n, bool neg, uint32_t whole, uint32_t frac, unsigned digits, unsigned width, unsigned flags)
+{
+    char tmp[sizeof("-4294967295.") + FRAC_MAX_DIGITS];
+    char *p = tmp;
+    if (neg) {
+        *p++ = '-';
+    } else if (flags & ZFIX_PLUS) {
+        *p++ = '+';
+    } else if (flags & ZFIX_SPACE) {
+        *p++ = ' ';
+    }
+    const size_t signlen = p - tmp;
+    const zs_flags_t plain = { 0 };
+    p = zu32toa(p, whole, 0, plain);
+    // the fraction follows its leading zeros, after tmp
+    const unsigned lead = digits > FRAC_MAX_DIGITS ? digits - FRAC_MAX_DIGITS : 0;
+    const char *fraction = p;
+    if (digits) {
+        const zs_flags_t zeropad = { .zeropad = 1 };
+        *p++ = '.';
+        fraction = p;
+        p = zu32toa(p, frac, digits - lead, zeropad);
+    }
+    zout_t out = { .dest = buf, .remain = n };
+    const size_t len = p - tmp + lead;
+    const size_t padlen = width > len ? width - len : 0;
+    if (!(flags & (ZFIX_LEFT | ZFIX_ZEROPAD))) {
+        fill(&out, ' ', padlen);
+    }
+    emit(&out, tmp, signlen);
+    if ((flags & ZFIX_ZEROPAD) && !(flags & ZFIX_LEFT)) {
+        fill(&out, '0', padlen);
+    }
+    emit(&out, tmp + signlen, fraction - tmp - signlen);
+    fill(&out, '0', lead);
+    emit(&out, fraction, p - fraction);
+    if (flags & ZFIX_LEFT) {
+        fill(&out, ' ', padlen);
+    }
+    return finish(&out, buf, n);
+}
+
+/**
+ * Print a decimal fixed-point integer, e.g. milli-units, using integer
+ * arithmetic only: zfixtoa(buf, n, -12345, 3, 0, 0) prints "-12.345".
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param v value scaled by 10^decimals
+ * @param decimals number of decimal places in v; from 10 on, every digit
+ *        of v is in the fraction
+ * @param width field width, or 0
+ * @param flags ZFIX_* flags, as the printf flags for %f
+ * @return number of characters in the full output, as for zvsnprintf
+ */
+size_t zfixtoa(char *buf, size_t n, int32_t v, unsigned decimals, unsigned width, unsigned flags)
+{
+    const uint32_t mag = v < 0 ? -(uint32_t)v : (uint32_t)v;
+    if (decimals > FIXED_MAX_DIGITS) {
+        // 10^decimals exceeds any magnitude
+        return fixedOut(buf, n, v < 0, 0, mag, decimals, width, flags);
+    }
+    const uint32_t scale = pow10_u32[decimals];
+    return fixedOut(buf, n, v < 0, mag / scale, mag % scale, decimals, width, flags);
+}
+
+/**
+ * Print a binary fixed-point integer, e.g. Q15 or Q16.16, as a decimal with
+ * the given precision, rounded half away from zero, using integer
+ * arithmetic only: zqtoa(buf, n, 0x18000, 16, 3, 0, 0) prints "1.500".
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param v value scaled by 2^frac_bits
+ * @param frac_bits number of fraction bits in v, up to 31
+ * @param precision number of decimal places to print, up to 9
+ * @param width field width, or 0
+ * @param flags ZFIX_* flags, as the printf flags for %f
+ * @return number of characters in the full output, as for zvsnprintf
+ */
+size_t zqtoa(char *buf, size_t n, int32_t v, unsigned frac_bits, unsigned precision, unsigned width, unsigned flags)
+{
+    if (frac_bits > 31) {
+        frac_bits = 31;
+    }
+    if (precision > FIXED_MAX_DIGITS) {
+        precision = FIXED_MAX_DIGITS;
+    }
+    const uint32_t mag = v < 0 ? -(uint32_t)v : (uint32_t)v;
+    uint32_t whole = frac_bits ? mag >> frac_bits : mag;
+    const uint32_t rem = mag & (((uint32_t)1 << frac_bits) - 1);
+    const uint32_t scale = pow10_u32[precision];
+    // rem < 2^31 and scale <= 10^9, so the product fits in 64 bits
+    uint64_t frac = (uint64_t)rem * scale;
+    if (frac_bits) {
+        frac = (frac + ((uint64_t)1 << (frac_bits - 1))) >> frac_bits;
+    }
+    if (frac >= scale) {
+        // rounded up into the next integer
+        frac -= scale;
+        ++whole;
+    }
+    const bool neg = v < 0 && (whole || frac);
+    return fixedOut(buf, n, neg, whole, (uint32_t)frac, precision, width, flags);
+}
+
+#define TIMESTAMP_DATE_LEN (sizeof("YYYY-MM-DDT") - 1)
+#define NS_PER_SEC 1000000000
+#define SECS_PER_DAY 86400
+
+#if ZSNPRINTF_TIMESTAMP_CACHE
+// date part of the last timestamp printed by this thread
+static ZSNPRINTF_THREAD_LOCAL struct {
+    int64_t day; // days since the epoch, or INT64_MIN if none or being rewritten
+    char date[TIMESTAMP_DATE_LEN];
+} date_cache = { .day = INT64_MIN };
+#endif
+
+/**
+ * Print the "YYYY-MM-DDT" date part of a timestamp, converting days since
+ * the epoch to a proleptic Gregorian date with the era-based method of
+ * H. Hinnant, which needs no tables or loops.
+ *
+ * @param buf buffer of at least TIMESTAMP_DATE_LEN characters
+ * @param day days since 1970-01-01
+ */
+static void timestampDate(char *buf, int64_t day)
+{
+    // shift the epoch to 0000-03-01, so leap days fall at the end of a year
+    const int64_t z = day + 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = (unsigned)(z - era * 146097); // day of era, [0, 146096]
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // [0, 399]
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100); // [0, 365]
+    const unsigned mp = (5 * doy + 2) / 153; // March is 0
+    const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    // an int64_t of nanoseconds spans 1677 to 2262, so years have 4 digits
+    const unsigned y = (unsigned)(yoe + era * 400) + (m <= 2);
+    buf = putPair(buf, y / 100);
+    buf = putPair(buf, y % 100);
+    *buf++ = '-';
+    buf = putPair(buf, m);
+    *buf++ = '-';
+    buf = putPair(buf, d);
+    *buf = 'T';
+}
+
+/**
+ * Print a UTC timestamp in ISO 8601 form, e.g. "2026-10-14T09:30:15.123456"
+ * for digits == 6, as a log line prefix.  This is a fixed-length rendering
+ * from the pair table, much cheaper than formatting the seven fields with
+ * "%04d-%02d-%02dT%02d:%02d:%02d.%06u".  With ZSNPRINTF_TIMESTAMP_CACHE, the
+ * date part is cached per thread, so it's only regenerated when the day
+ * changes.
+ *
+ * @param buf output buffer
+ * @param n size of buf
+ * @param epoch_ns nanoseconds since 1970-01-01T00:00:00Z
+ * @param digits number of fraction digits to print, truncated, up to 9;
+ *        more are read as 9, and 0 prints no '.'
+ * @return number of characters in the full output, as for zvsnprintf
+ */
+size_t zformat_timestamp(char *buf, size_t n, int64_t epoch_ns, unsigned digits)
+{
+    if (digits > FIXED_MAX_DIGITS) {
+        digits = FIXED_MAX_DIGITS;
+    }
+    int64_t secs = epoch_ns / NS_PER_SEC;
+    int32_t ns = (int32_t)(epoch_ns % NS_PER_SEC);
+    if (ns < 0) {
+        ns += NS_PER_SEC;
+        --secs;
+    }
+    int64_t day = secs / SECS_PER_DAY;
+    int32_t tod = (int32_t)(secs % SECS_PER_DAY);
+    if (tod < 0) {
+        tod += SECS_PER_DAY;
+        --day;
+    }
+    char tmp[sizeof("YYYY-MM-DDTHH:MM:SS.") + FIXED_MAX_DIGITS];
+#if ZSNPRINTF_TIMESTAMP_CACHE
+    if (day != date_cache.day) {
+        // invalid while rewritten, in case an interrupt handler reads it
+        date_cache.day = INT64_MIN;
+        SIGNAL_FENCE();
+        timestampDate(date_cache.date, day);
+        SIGNAL_FENCE();
+        date_cache.day = day;
+    }
+    memcpy(tmp, date_cache.date, TIMESTAMP_DATE_LEN);
+    SIGNAL_FENCE();
+    if (date_cache.day != day) {
+        // an interrupt handler rewrote the cache during the copy
+        timestampDate(tmp, day);
+    }
+#else
+    timestampDate(tmp, day);
+#endif
+    char *p = tmp + TIMESTAMP_DATE_LEN;
+    p = putPair(p, (unsigned)tod / 3600);
+    *p++ = ':';
+    p = putPair(p, (unsigned)tod / 60 % 60);
+    *p++ = ':';
+    p = putPair(p, (unsigned)tod % 60);
+    if (digits) {
+        *p++ = '.';
+        p = zu32todigits(p, (uint32_t)ns / pow10_u32[FIXED_MAX_DIGITS - digits], digits);
+    }
+    zout_t out = { .dest = buf, .remain = n };
+    emit(&out, tmp, p - tmp);
+    return finish(&out, buf, n);
 }
@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   zsnprintf.h
  * Author: Michael Sandstedt
  *
@@ -11,6 +11,221 @@
 #define	ZSNPRINTF_H
 
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZS_ARG_SPECIFIED -2
+#define ZS_PRECISION_UNSPECIFIED -1
+
+// maximum number of literal spans + conversions in a compiled format.  It
+// sets the layout of zfmt_t, so it's fixed here for the library and all of
+// its clients rather than taken from config.h; change it only by editing
+// this header and rebuilding everything that includes it
+#define ZFMT_MAX_OPS 16
+
+// size of the chunk buffer inside a zsink_t; fixed here, as ZFMT_MAX_OPS is,
+// since it sets the layout of zsink_t
+#define ZSINK_CHUNK_SIZE 64
+
+// storage class for per-thread state; define as empty for single-threaded
+// targets whose toolchain lacks thread-local storage.  ZSNPRINTF_DETECTED_TLS
+// is set when it's chosen here and really is thread-local
+#ifndef ZSNPRINTF_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define ZSNPRINTF_THREAD_LOCAL _Thread_local
+#define ZSNPRINTF_DETECTED_TLS 1
+#elif defined(__cplusplus) && __cplusplus >= 201103L
+#define ZSNPRINTF_THREAD_LOCAL thread_local
+#define ZSNPRINTF_DETECTED_TLS 1
+#elif defined(__GNUC__)
+#define ZSNPRINTF_THREAD_LOCAL __thread
+#define ZSNPRINTF_DETECTED_TLS 1
+#else
+#define ZSNPRINTF_THREAD_LOCAL
+#endif
+#endif
+
+typedef enum zs_sign_e {
+    zs_auto_sign,
+    zs_always_sign,
+    zs_sign_or_space,
+} zs_sign_t;
+
+typedef enum zs_exp_form_e {
+    zs_exp_none,
+    zs_exp_e,
+    zs_exp_E,
+} zs_exp_form_t;
+
+typedef struct zs_flags_s {
+    unsigned leftAlign : 1;
+    unsigned sign : 2;
+    unsigned altForm : 1;
+    unsigned zeropad : 1;
+    unsigned exp : 2;
+} zs_flags_t;
+
+typedef enum zs_length_e {
+    zs_length_int,
+    zs_length_long,
+    zs_length_long_long,
+} zs_length_t;
+
+/**
+ * A single parsed conversion specification, e.g. the "%08llx" of a format.
+ */
+typedef struct zspec_s {
+    zs_flags_t flags;
+    int width; // 0 if unspecified, ZS_ARG_SPECIFIED for '*'
+    int precision; // ZS_PRECISION_UNSPECIFIED, or ZS_ARG_SPECIFIED for '.*'
+    zs_length_t length;
+    char specifier; // conversion character, e.g. 'x', or '4'/'6'/'M'/'U' for %pI4/%pI6/%pM/%pU; '\0' for none
+} zspec_t;
+
+// maximum precision of a prepared %f spec
+#define ZFSPEC_MAX_PRECISION 17
+
+/**
+ * A %f conversion prepared by zfspec_prepare, for printing many values with
+ * the same width and precision.  The scale is computed once, not per value.
+ */
+typedef struct zfspec_s {
+    zspec_t spec; // the conversion, with width and precision resolved
+    double scale; // 10^precision
+    double scale_hi, scale_lo; // scale split into 26-bit halves
+    uint64_t limit; // 10^precision, where the rounded fraction carries
+} zfspec_t;
+
+/**
+ * One step of a compiled format: a literal span from the format string,
+ * followed by an optional conversion.
+ */
+typedef struct zfmt_op_s {
+    const char *lit;
+    size_t litlen;
+    zspec_t spec;
+} zfmt_op_t;
+
+/**
+ * A format string parsed once by zformat_compile.  The format string must
+ * outlive the compiled object, as literal spans point into it.
+ */
+typedef struct zfmt_s {
+    unsigned nops;
+    zfmt_op_t ops[ZFMT_MAX_OPS];
+} zfmt_t;
+
+/**
+ * Streaming output target for zvcbprintf.  Output is staged in chunk and
+ * passed to write whenever the chunk fills, and once more at the end of each
+ * call; spans longer than the chunk are passed to write directly.
+ */
+typedef struct zsink_s {
+    void (*write)(void *ctx, const char *data, size_t len);
+    void *ctx;
+    char chunk[ZSINK_CHUNK_SIZE];
+} zsink_t;
+
+/**
+ * Conversion for a specifier added with zspec_register.  It takes its
+ * arguments from ap with va_arg, whether or not there's room for the output,
+ * and prints at most remain characters to dest, with no terminating '\0'.
+ *
+ * @param dest where to print; NULL if remain is 0
+ * @param remain room at dest
+ * @param ap arguments, positioned at the conversion's first argument
+ * @param spec the conversion, with any '*' width and '.*' precision resolved
+ * @return length of the full output, including any that didn't fit
+ */
+typedef size_t (*zspec_handler_t)(char *dest, size_t remain, va_list *ap, const zspec_t *spec);
+
+typedef enum zarg_type_e {
+    zarg_int,
+    zarg_long,
+    zarg_long_long,
+    zarg_float,
+    zarg_double,
+    zarg_long_double,
+    zarg_ptr,
+    zarg_str,
+} zarg_type_t;
+
+/**
+ * One argument for zsnprintf_args, tagged with its type.  Unsigned values
+ * are stored in the signed member of the same width.
+ */
+typedef struct zarg_s {
+    zarg_type_t type;
+    union {
+        int i;
+        long l;
+        long long ll;
+        float f;
+        double d;
+        long double ld;
+        const void *p;
+        const char *s;
+    } v;
+} zarg_t;
+
+#define ZARG_INT(_v) ((zarg_t){ .type = zarg_int, .v.i = (_v) })
+#define ZARG_LONG(_v) ((zarg_t){ .type = zarg_long, .v.l = (_v) })
+#define ZARG_LONG_LONG(_v) ((zarg_t){ .type = zarg_long_long, .v.ll = (_v) })
+#define ZARG_FLOAT(_v) ((zarg_t){ .type = zarg_float, .v.f = (_v) })
+#define ZARG_DOUBLE(_v) ((zarg_t){ .type = zarg_double, .v.d = (_v) })
+#define ZARG_LONG_DOUBLE(_v) ((zarg_t){ .type = zarg_long_double, .v.ld = (_v) })
+#define ZARG_PTR(_v) ((zarg_t){ .type = zarg_ptr, .v.p = (_v) })
+#define ZARG_STR(_v) ((zarg_t){ .type = zarg_str, .v.s = (_v) })
+
+/**
+ * Specifier classes counted by a ZSNPRINTF_STATS build; %i counts as %d,
+ * %X as %x, %F as %f, %E/%a/%A as %e and %G as %g.
+ */
+typedef enum zstat_class_e {
+    zstat_d,
+    zstat_u,
+    zstat_x,
+    zstat_o,
+    zstat_f,
+    zstat_e,
+    zstat_g,
+    zstat_s,
+    zstat_c,
+    zstat_p,
+    ZSTAT_CLASSES
+} zstat_class_t;
+
+/**
+ * Counters for one specifier class and length.
+ */
+typedef struct zstat_s {
+    uint64_t calls;
+    uint64_t bytes; // output length, including any past the end of the buffer
+    uint64_t truncated; // conversions cut short by the end of the buffer
+    uint64_t cycles; // ZSNPRINTF_STATS_CYCLES() units; 0 if not defined
+} zstat_t;
+
+/**
+ * One thread's counters from a ZSNPRINTF_STATS build.  h and hh count under
+ * zs_length_int, L under zs_length_long, and j, z and t under the length they
+ * select for the target.
+ */
+typedef struct zsnprintf_stats_s {
+    zstat_t conv[ZSTAT_CLASSES][zs_length_long_long + 1]; // by class, then length
+    uint64_t calls; // formatting calls
+    uint64_t truncated; // calls whose output didn't fit their buffer
+} zsnprintf_stats_t;
+
+// flags for zfixtoa and zqtoa, named for the printf flag they stand for
+#define ZFIX_LEFT 0x1 // '-': pad on the right
+#define ZFIX_PLUS 0x2 // '+': sign positive values
+#define ZFIX_SPACE 0x4 // ' ': a space before positive values
+#define ZFIX_ZEROPAD 0x8 // '0': pad with zeros after the sign
 
 size_t zvsnprintf(char *buf, size_t n, const char *fmt, va_list ap);
 #ifdef __GNUC__
@@ -19,5 +234,65 @@ size_t zsnprintf(char *buf, size_t n, const char *fmt, ...) __attribute__((forma
 size_t zsnprintf(char* buf, size_t n, const char* fmt, ...);
 #endif
 
-#endif	/* ZSNPRINTF_H */
+size_t zvsnprintf_trunc(char *buf, size_t n, bool *truncated, const char *fmt, va_list ap);
+#ifdef __GNUC__
+size_t zsnprintf_trunc(char *buf, size_t n, bool *truncated, const char *fmt, ...) __attribute__((format (printf, 4, 5)));
+#else
+size_t zsnprintf_trunc(char *buf, size_t n, bool *truncated, const char *fmt, ...);
+#endif
+
+bool zformat_compile(const char *fmt, zfmt_t *out);
+size_t zvsnprintf_compiled(char *buf, size_t n, const zfmt_t *fmt, va_list ap);
+size_t zsnprintf_compiled(char *buf, size_t n, const zfmt_t *fmt, ...);
+size_t zsnprintf_batch(const zfmt_t *fmt, const zarg_t *args, size_t nrec, char *out, size_t outsz, size_t *offsets);
 
+size_t zsnprintf_args(char *buf, size_t n, const char *fmt, const zarg_t *args, size_t nargs);
+
+size_t zvcbprintf(zsink_t *sink, const char *fmt, va_list ap);
+#ifdef __GNUC__
+size_t zcbprintf(zsink_t *sink, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
+#else
+size_t zcbprintf(zsink_t *sink, const char *fmt, ...);
+#endif
+
+size_t zvcapture(void *rec, size_t n, const char *fmt, va_list ap);
+#ifdef __GNUC__
+size_t zcapture(void *rec, size_t n, const char *fmt, ...) __attribute__((format (printf, 3, 4)));
+#else
+size_t zcapture(void *rec, size_t n, const char *fmt, ...);
+#endif
+size_t zrender(char *buf, size_t n, const void *rec);
+
+bool zspec_register(char specifier, zspec_handler_t handler);
+bool zspec_parse(const char *conv, zspec_t *spec);
+size_t zformat_i32_array(char *buf, size_t n, const int32_t *v, size_t count, const zspec_t *spec, const char *sep);
+size_t zformat_u64_array(char *buf, size_t n, const uint64_t *v, size_t count, const zspec_t *spec, const char *sep);
+size_t zformat_f32_array(char *buf, size_t n, const float *v, size_t count, const zspec_t *spec, const char *sep);
+size_t zformat_f64_array(char *buf, size_t n, const double *v, size_t count, const zspec_t *spec, const char *sep);
+
+bool zfspec_prepare(const zspec_t *spec, zfspec_t *fs);
+size_t zformat_fspec(char *buf, size_t n, const zfspec_t *fs, double v);
+size_t zformat_fspec_array(char *buf, size_t n, const double *v, size_t count, const zfspec_t *fs, const char *sep);
+
+size_t zformat_int(char *buf, size_t n, const zspec_t *spec, long long unsigned v);
+size_t zformat_double(char *buf, size_t n, const zspec_t *spec, double v);
+size_t zformat_long_double(char *buf, size_t n, const zspec_t *spec, long double v);
+size_t zformat_str(char *buf, size_t n, const zspec_t *spec, const char *s);
+size_t zformat_ptr(char *buf, size_t n, const zspec_t *spec, const void *p);
+
+size_t zhexdump(char *buf, size_t n, const void *data, size_t len, bool upper);
+
+size_t zfixtoa(char *buf, size_t n, int32_t v, unsigned decimals, unsigned width, unsigned flags);
+size_t zqtoa(char *buf, size_t n, int32_t v, unsigned frac_bits, unsigned precision, unsigned width, unsigned flags);
+
+size_t zformat_timestamp(char *buf, size_t n, int64_t epoch_ns, unsigned digits);
+
+// only defined in a ZSNPRINTF_STATS build
+void zsnprintf_stats_get(zsnprintf_stats_t *stats);
+void zsnprintf_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* ZSNPRINTF_H */
@@ -0,0 +1,419 @@
+/*
+ * File:   zsnprintf.hpp
+ *
+ * Created on October 14, 2026
+ *
+ * C++20 front end for zsnprintf with the format string parsed at compile
+ * time:
+ *
+ *    char buf[64];
+ *    size_t len = zs::format<"id=%08x t=%llu">(buf, sizeof(buf), id, t);
+ *
+ * The format is split into literal spans and conversion specs as constants,
+ * so there's no parsing and no va_list at run time; literals are copied with
+ * constant lengths and each conversion calls the matching zformat_int,
+ * zformat_double, etc. with a constant zspec_t.  Arguments are checked
+ * against their conversions when the call is compiled: a mismatched type,
+ * a value wider than the length modifier allows, a wrong argument count, an
+ * invalid conversion or %n is an error rather than undefined behavior.
+ * %pI4, %pI6, %pM, %pM8 and %pU take a pointer to the address bytes, and
+ * print the address only if zsnprintf.c is built with ZSNPRINTF_ADDRESSES.
+ *
+ * Output, truncation and the return value are as for zsnprintf.
+ */
+
+#ifndef ZSNPRINTF_HPP
+#define ZSNPRINTF_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "zsnprintf.h"
+
+namespace zs {
+
+/**
+ * A string literal usable as a template argument, e.g. the "..." of
+ * zs::format<"...">.
+ */
+template <std::size_t N>
+struct fixed_string {
+    char data[N] = {};
+
+    constexpr fixed_string(const char (&s)[N])
+    {
+        for (std::size_t i = 0; i < N; ++i) {
+            data[i] = s[i];
+        }
+    }
+
+    static constexpr std::size_t size = N - 1;
+};
+
+namespace detail {
+
+enum parse_error {
+    parse_ok,
+    parse_invalid, // '%' not followed by a valid conversion
+    parse_n, // %n can't be checked, so isn't supported
+};
+
+/**
+ * One step of a parsed format: a literal span followed by an optional
+ * conversion, as in zfmt_op_t.
+ */
+struct op {
+    std::size_t lit; // offset of the literal span in parsed::lits
+    std::size_t litlen;
+    zspec_t spec; // specifier '\0' for a literal span alone
+    std::size_t arg; // index of the first argument the conversion consumes
+};
+
+/**
+ * A format string parsed at compile time.  Escaped '%' characters are folded
+ * into the literal spans, so lits holds the literal text unescaped.
+ */
+template <std::size_t N>
+struct parsed {
+    op ops[N / 2 + 1] = {};
+    std::size_t nops = 0;
+    char lits[N + 1] = {};
+    std::size_t nargs = 0;
+    parse_error error = parse_ok;
+};
+
+constexpr bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr zs_length_t lengthOf(std::size_t bytes)
+{
+    return   bytes <= sizeof(unsigned) ? zs_length_int
+           : bytes <= sizeof(unsigned long) ? zs_length_long
+           : zs_length_long_long;
+}
+
+/**
+ * Parse a decimal field, saturating as scanSpec does.
+ */
+constexpr int scanDecimal(const char *s, std::size_t &i)
+{
+    int val = 0;
+    for (; isDigit(s[i]); ++i) {
+        if (val < 100000) {
+            val = 10 * val + (s[i] - '0');
+        }
+    }
+    return val;
+}
+
+/**
+ * Parse the conversion introduced by the '%' at s[i], as scanSpec does.
+ *
+ * @param s format string
+ * @param i (in/out) index of the '%'; advanced past the conversion
+ * @param spec (out) parsed conversion; specifier is '\0' if invalid
+ */
+constexpr void scanSpec(const char *s, std::size_t &i, zspec_t &spec)
+{
+    spec = zspec_t{};
+    spec.precision = ZS_PRECISION_UNSPECIFIED;
+    for (++i;; ++i) {
+        const char c = s[i];
+        if (c == '-') {
+            spec.flags.leftAlign = 1;
+        } else if (c == '+') {
+            spec.flags.sign = zs_always_sign;
+        } else if (c == ' ') {
+            if (spec.flags.sign != zs_always_sign) {
+                spec.flags.sign = zs_sign_or_space;
+            }
+        } else if (c == '#') {
+            spec.flags.altForm = 1;
+        } else if (c == '0') {
+            spec.flags.zeropad = 1;
+        } else {
+            break;
+        }
+    }
+    if (s[i] == '*') {
+        spec.width = ZS_ARG_SPECIFIED;
+        ++i;
+    } else {
+        spec.width = scanDecimal(s, i);
+    }
+    if (s[i] == '.') {
+        ++i;
+        if (s[i] == '*') {
+            spec.precision = ZS_ARG_SPECIFIED;
+            ++i;
+        } else if (isDigit(s[i])) {
+            spec.precision = scanDecimal(s, i);
+        }
+    }
+    switch (s[i]) {
+        case 'h': spec.length = zs_length_int; i += s[i + 1] == 'h' ? 2 : 1; break;
+        case 'l':
+            spec.length = s[i + 1] == 'l' ? zs_length_long_long : zs_length_long;
+            i += s[i + 1] == 'l' ? 2 : 1;
+            break;
+        case 'L': spec.length = zs_length_long; ++i; break;
+        case 'j': spec.length = lengthOf(sizeof(long long)); ++i; break;
+        case 'z': spec.length = lengthOf(sizeof(std::size_t)); ++i; break;
+        case 't': spec.length = lengthOf(sizeof(std::ptrdiff_t)); ++i; break;
+    }
+    if (s[i] == 'p') {
+        // %pI4, %pI6, %pM or %pU, as scanSpec reads them
+        if (s[i + 1] == 'I' && (s[i + 2] == '4' || s[i + 2] == '6')) {
+            spec.specifier = s[i + 2];
+            i += 3;
+            return;
+        }
+        if (s[i + 1] == 'M' && s[i + 2] == '8') {
+            spec.specifier = 'M';
+            spec.precision = 8; // EUI-64
+            i += 3;
+            return;
+        }
+        if (s[i + 1] == 'M' || s[i + 1] == 'U') {
+            spec.specifier = s[i + 1];
+            i += 2;
+            return;
+        }
+    }
+    for (const char c : "diuxXofFeEgGaAscpn%") {
+        if (c && s[i] == c) {
+            spec.specifier = c;
+            ++i;
+            return;
+        }
+    }
+    spec.specifier = '\0';
+}
+
+/**
+ * Split a format into literal spans and conversions, counting the arguments
+ * they consume.
+ */
+template <std::size_t N>
+constexpr parsed<N> parse(const char (&s)[N + 1])
+{
+    parsed<N> p;
+    std::size_t nlits = 0;
+    op cur = {};
+    for (std::size_t i = 0; i < N;) {
+        if (s[i] != '%') {
+            p.lits[nlits++] = s[i++];
+            ++cur.litlen;
+            continue;
+        }
+        zspec_t spec;
+        scanSpec(s, i, spec);
+        if (!spec.specifier || (spec.specifier == '%' && (spec.width == ZS_ARG_SPECIFIED || spec.precision == ZS_ARG_SPECIFIED))) {
+            p.error = parse_invalid;
+            return p;
+        }
+        if (spec.specifier == 'n') {
+            p.error = parse_n;
+            return p;
+        }
+        if (spec.specifier == '%') {
+            p.lits[nlits++] = '%';
+            ++cur.litlen;
+            continue;
+        }
+        cur.spec = spec;
+        cur.arg = p.nargs;
+        p.nargs += (spec.width == ZS_ARG_SPECIFIED) + (spec.precision == ZS_ARG_SPECIFIED) + 1;
+        p.ops[p.nops++] = cur;
+        cur = op{ nlits, 0, {}, 0 };
+    }
+    if (cur.litlen) {
+        p.ops[p.nops++] = cur;
+    }
+    return p;
+}
+
+template <fixed_string Fmt>
+inline constexpr auto parsed_v = parse<Fmt.size>(Fmt.data);
+
+/**
+ * Output position; conversion results are accumulated in len beyond the end
+ * of the buffer so the full length is returned, as zsnprintf does.
+ */
+struct cursor {
+    char *buf;
+    std::size_t n;
+    std::size_t len;
+
+    char *dest() const { return len < n ? buf + len : nullptr; }
+    std::size_t room() const { return len < n ? n - len : 0; }
+};
+
+inline void literal(cursor &out, const char *s, std::size_t len)
+{
+    if (out.len + 1 < out.n) {
+        const std::size_t avail = out.n - 1 - out.len;
+        std::memcpy(out.buf + out.len, s, len < avail ? len : avail);
+    }
+    out.len += len;
+}
+
+constexpr bool isIntSpec(char c)
+{
+    return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'o';
+}
+
+constexpr bool isFloatSpec(char c)
+{
+    return    c == 'f' || c == 'F' || c == 'e' || c == 'E'
+           || c == 'g' || c == 'G' || c == 'a' || c == 'A';
+}
+
+constexpr bool isAddrSpec(char c)
+{
+    return c == '4' || c == '6' || c == 'M' || c == 'U';
+}
+
+constexpr std::size_t lengthBytes(zs_length_t length)
+{
+    return   length == zs_length_int ? sizeof(unsigned)
+           : length == zs_length_long ? sizeof(unsigned long)
+           : sizeof(unsigned long long);
+}
+
+template <typename T>
+constexpr unsigned long long intBits(T v)
+{
+    if constexpr (std::is_signed_v<T>) {
+        return static_cast<unsigned long long>(static_cast<long long>(v));
+    } else {
+        return static_cast<unsigned long long>(v);
+    }
+}
+
+/**
+ * Read a '*' width or precision argument.
+ */
+template <typename A>
+constexpr int starArg(const A &v)
+{
+    using T = std::decay_t<A>;
+    static_assert(std::is_integral_v<T> && sizeof(T) <= sizeof(int),
+                  "zs::format: '*' width and precision take an int argument");
+    return static_cast<int>(v);
+}
+
+/**
+ * Convert one argument, checking its type against the conversion.
+ */
+template <char S, zs_length_t L, typename A>
+inline void convert(cursor &out, const zspec_t *spec, const A &v)
+{
+    using T = std::decay_t<A>;
+    if constexpr (isIntSpec(S) || S == 'c') {
+        static_assert(std::is_integral_v<T>, "zs::format: integer conversion needs an integral argument");
+        static_assert(sizeof(T) <= (S == 'c' ? sizeof(int) : lengthBytes(L)),
+                      "zs::format: argument is wider than the conversion's length modifier");
+        out.len += zformat_int(out.dest(), out.room(), spec, intBits(v));
+    } else if constexpr (isFloatSpec(S)) {
+        static_assert(std::is_floating_point_v<T>, "zs::format: floating point conversion needs a floating point argument");
+        static_assert((L == zs_length_long) == std::is_same_v<T, long double>,
+                      "zs::format: long double arguments need the 'L' length modifier, and only they take it");
+        if constexpr (std::is_same_v<T, long double>) {
+            out.len += zformat_long_double(out.dest(), out.room(), spec, v);
+        } else {
+            out.len += zformat_double(out.dest(), out.room(), spec, v);
+        }
+    } else if constexpr (S == 's') {
+        constexpr bool ok = std::is_convertible_v<T, const char *> && !std::is_null_pointer_v<T>;
+        static_assert(ok, "zs::format: %s needs a C string argument");
+        if constexpr (ok) {
+            out.len += zformat_str(out.dest(), out.room(), spec, v);
+        }
+    } else if constexpr (S == 'p') {
+        constexpr bool ok = std::is_pointer_v<T> || std::is_null_pointer_v<T>;
+        static_assert(ok, "zs::format: %p needs a pointer argument");
+        if constexpr (ok) {
+            out.len += zformat_ptr(out.dest(), out.room(), spec, static_cast<const void *>(v));
+        }
+    } else if constexpr (isAddrSpec(S)) {
+        constexpr bool ok = std::is_pointer_v<T>;
+        static_assert(ok, "zs::format: %pI4, %pI6, %pM and %pU need a pointer to the address bytes");
+        if constexpr (ok) {
+            out.len += zformat_ptr(out.dest(), out.room(), spec, static_cast<const void *>(v));
+        }
+    }
+}
+
+/**
+ * Emit op I of the parsed format, consuming its arguments from the tuple.
+ */
+template <fixed_string Fmt, std::size_t I, typename Args>
+inline void step(cursor &out, const Args &args)
+{
+    constexpr const auto &p = parsed_v<Fmt>;
+    constexpr op o = p.ops[I];
+    if constexpr (o.litlen != 0) {
+        literal(out, p.lits + o.lit, o.litlen);
+    }
+    if constexpr (o.spec.specifier != '\0') {
+        constexpr bool starWidth = o.spec.width == ZS_ARG_SPECIFIED;
+        constexpr bool starPrecision = o.spec.precision == ZS_ARG_SPECIFIED;
+        constexpr std::size_t arg = o.arg + starWidth + starPrecision;
+        if constexpr (starWidth || starPrecision) {
+            zspec_t spec = o.spec;
+            if constexpr (starWidth) {
+                spec.width = starArg(std::get<o.arg>(args));
+            }
+            if constexpr (starPrecision) {
+                spec.precision = starArg(std::get<o.arg + starWidth>(args));
+            }
+            convert<o.spec.specifier, o.spec.length>(out, &spec, std::get<arg>(args));
+        } else {
+            static constexpr zspec_t spec = o.spec;
+            convert<o.spec.specifier, o.spec.length>(out, &spec, std::get<arg>(args));
+        }
+    }
+}
+
+template <fixed_string Fmt, typename Args, std::size_t... I>
+inline void steps(cursor &out, const Args &args, std::index_sequence<I...>)
+{
+    (step<Fmt, I>(out, args), ...);
+}
+
+} // namespace detail
+
+/**
+ * Format into buf per a format string parsed at compile time.
+ *
+ * @param buf output buffer; may be NULL if n is 0
+ * @param n size of buf
+ * @param args arguments, checked against the format when compiled
+ * @return number of characters in the full output, excluding the NUL, as
+ *         for zsnprintf
+ */
+template <fixed_string Fmt, typename... Args>
+inline std::size_t format(char *buf, std::size_t n, const Args &...args)
+{
+    constexpr const auto &p = detail::parsed_v<Fmt>;
+    static_assert(p.error != detail::parse_invalid, "zs::format: invalid conversion specification");
+    static_assert(p.error != detail::parse_n, "zs::format: %n isn't supported");
+    static_assert(p.nargs == sizeof...(Args), "zs::format: argument count doesn't match the format");
+    detail::cursor out = { buf, n, 0 };
+    if constexpr (p.error == detail::parse_ok) {
+        detail::steps<Fmt>(out, std::forward_as_tuple(args...), std::make_index_sequence<p.nops>{});
+    }
+    if (n) {
+        buf[out.len < n ? out.len : n - 1] = '\0';
+    }
+    return out.len;
+}
+
+} // namespace zs
+
+#endif /* ZSNPRINTF_HPP */